@@ -0,0 +1,38 @@
+#pragma once
+#include "tensor.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Checkpoint file layout (little endian):
+//
+//   header   "HMLCKPT\0" | u32 version | u32 count | u64 data_start
+//   entries  count x { u32 name_len | name | u8 dtype | u8 ndim | u64 dims[ndim] | u64 offset | u64 nbytes }
+//   data     each tensor's elements at `offset`, padded so every offset is 64 byte aligned
+//
+// Offsets are absolute, so a loader can mmap the file and point tensors straight
+// at the mapped pages.
+namespace hml::checkpoint {
+    inline constexpr char magic[8] = {'H', 'M', 'L', 'C', 'K', 'P', 'T', '\0'};
+    inline constexpr std::uint32_t version = 1;
+    inline constexpr std::size_t alignment = 64;
+
+    enum class dtype : std::uint8_t { f32 = 0 };
+
+    using entry = std::pair<std::string, const tensor::tensor*>;
+
+    // Writes every tensor in one pass (header first, then data in entry order)
+    // to path + ".tmp.<pid>", fsyncs it and renames it over path, so processes
+    // that still map the old file are unaffected and a crash never leaves a torn
+    // checkpoint. Names must be unique. Throws std::runtime_error on I/O failure.
+    void save(const std::string& path, const std::vector<entry>& tensors);
+
+    // Maps the file read/write private and returns tensors that point into the
+    // mapping. Nothing is copied: pages are shared with every other process that
+    // maps the same file until one of them writes to a tensor. The mapping is
+    // released when the last returned tensor is destroyed. Throws
+    // std::runtime_error on a malformed file, including a repeated name.
+    std::unordered_map<std::string, tensor::tensor> load(const std::string& path);
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Gradient exchange for data-parallel training. Ranks form a ring; each holds
+// one stream socket to its right neighbour and one from its left, and sums
+// arrays with the bandwidth-optimal ring all-reduce (reduce-scatter, then
+// all-gather), so every rank sends about 2 * (world - 1) / world of the array
+// regardless of world size.
+namespace hml::dist {
+    // Where rank r listens:
+    //   "unix:/tmp/nhl_ring"            -> /tmp/nhl_ring.r
+    //   "tcp:10.0.0.1,10.0.0.2:29500"   -> host[r % hosts], port 29500 + r
+    struct endpoint {
+        bool unix_socket = true;
+        std::string path;   // unix
+        std::string host;   // tcp
+        std::uint16_t port = 0;
+    };
+    endpoint endpoint_for(const std::string& address, std::size_t rank);
+
+    class ring {
+        public:
+            // Listens on this rank's endpoint, connects to rank + 1 and accepts rank - 1,
+            // retrying until every link is up. Throws std::runtime_error on timeout,
+            // leaving no sockets behind.
+            ring(std::size_t rank, std::size_t world, const std::string& address,
+                 std::chrono::milliseconds timeout = std::chrono::seconds(60));
+            ~ring();
+
+            ring(const ring&) = delete;
+            ring& operator=(const ring&) = delete;
+
+            std::size_t rank() const noexcept;
+            std::size_t world() const noexcept;
+
+            // Sums data across every rank, in place. All ranks must make the same
+            // sequence of calls with the same sizes. Throws if a peer goes away.
+            void all_reduce(std::span<float> data);
+
+            std::uint64_t bytes_sent() const noexcept;
+
+        private:
+            // Sends and receives at the same time so neighbours never wait on each other.
+            void exchange(const void* send, std::size_t send_bytes, void* recv, std::size_t recv_bytes);
+            // Closes every socket and removes the unix listen path; safe to repeat.
+            void close_all() noexcept;
+
+            std::size_t rank_;
+            std::size_t world_;
+            int listen_fd_ = -1;
+            int left_fd_ = -1;
+            int right_fd_ = -1;
+            std::string unix_path_;
+            std::vector<float> recv_;
+            std::uint64_t bytes_sent_ = 0;
+    };
+
+    // Overlaps the gradient all-reduce with backward. Backward reports finished
+    // ranges of the flat gradient; adjacent ranges are gathered into buckets of at
+    // least bucket_size floats, and a background thread reduces each bucket (and
+    // divides it by the world size) while backward moves on to earlier layers.
+    // Every rank must report the same ranges in the same order.
+    class bucket_reducer {
+        public:
+            bucket_reducer(ring& r, std::size_t bucket_size);
+            ~bucket_reducer();
+
+            bucket_reducer(const bucket_reducer&) = delete;
+            bucket_reducer& operator=(const bucket_reducer&) = delete;
+
+            // Starts a step over grads, which must stay alive until finish().
+            void begin(std::span<float> grads);
+            void ready(std::size_t begin, std::size_t end);
+            // Sends the last partial bucket and waits until every bucket is averaged.
+            // Rethrows any error from the background thread.
+            void finish();
+
+            // For the last step: seconds the background thread spent reducing, and
+            // seconds finish() blocked, i.e. communication backward did not hide.
+            double comm_seconds() const noexcept;
+            double exposed_seconds() const noexcept;
+
+        private:
+            void flush();
+            void loop();
+
+            ring& ring_;
+            std::size_t bucket_size_;
+            std::span<float> grads_;
+            std::size_t pending_lo_ = 0;
+            std::size_t pending_hi_ = 0;
+
+            std::mutex mutex_;
+            std::condition_variable cv_;
+            std::condition_variable done_cv_;
+            std::deque<std::pair<std::size_t, std::size_t>> queue_;
+            std::size_t in_flight_ = 0;
+            bool stop_ = false;
+            std::exception_ptr error_;
+            double comm_seconds_ = 0.0;
+            double exposed_seconds_ = 0.0;
+            std::jthread worker_;
+    };
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include "model.hpp"
+#include "play.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace hml::serving {
+    // Wire format over the Unix socket: the client sends request_frames and gets
+    // one response_frame back per request, in the order the server finished them.
+    struct request_frame {
+        std::uint64_t request_id = 0;
+        play::play_event play;
+    };
+
+    enum class status : std::uint32_t { ok = 0, error = 1 };
+
+    struct response_frame {
+        std::uint64_t request_id = 0;
+        status code = status::ok;
+        float win_prob = 0.0f;
+        float next_event[play::vocab_size] = {};
+    };
+
+    struct server_options {
+        std::string socket_path = "/tmp/nhl_transformer.sock";
+        std::size_t max_batch = 32;
+        std::size_t max_wait_us = 500;
+        // A game with no plays for this long loses its session and cache, so
+        // games that never send game_end (a client that dropped) do not pile up.
+        // Longer than an intermission; a game that comes back after that starts
+        // a fresh history.
+        std::size_t session_idle_ms = 30 * 60 * 1000;
+        // Replies are never written blocking: what a client's socket will not take
+        // waits in its outbox, and a client that lets this many bytes pile up has
+        // stopped reading and is disconnected.
+        std::size_t max_reply_backlog = 1 << 20;
+    };
+
+    struct latency_summary {
+        std::size_t count = 0;
+        double mean_us = 0.0;
+        double p50_us = 0.0;
+        double p99_us = 0.0;
+        double max_us = 0.0;
+    };
+
+    latency_summary summarize(std::vector<double> samples_us);
+
+    bool read_full(int fd, void* buf, std::size_t n);
+    bool write_full(int fd, const void* buf, std::size_t n);
+
+    // Accepts connections on a Unix socket and scores each incoming play against
+    // its game's history. Requests from all connections are batched: a batch
+    // closes when it reaches max_batch or max_wait_us after its first request.
+    // Each live game keeps a kv_cache, so a play costs one token of compute no
+    // matter how far into the game it is.
+    class inference_server {
+        public:
+            inference_server(model::transformer model, server_options opts);
+            ~inference_server();
+
+            inference_server(const inference_server&) = delete;
+            inference_server& operator=(const inference_server&) = delete;
+
+            // Blocks until stop() is called.
+            void run();
+            // Safe to call from a signal handler.
+            void stop() noexcept;
+
+            // Enqueue-to-response latency for every request served so far.
+            latency_summary stats() const;
+            std::size_t batches() const noexcept;
+            // Clients currently connected. A closed connection is dropped within
+            // one accept poll (100 ms).
+            std::size_t connections() const;
+            // Games with a live session.
+            std::size_t sessions() const noexcept;
+
+        private:
+            // Closed once the reader has seen EOF and the last queued request on it
+            // has been answered, i.e. when the last pending drops its reference.
+            struct connection {
+                int fd = -1;
+                std::atomic<bool> closed{false};   // set by the reader on EOF or error
+
+                std::mutex write_mutex;
+                std::string outbox;                // reply bytes the socket has not taken yet
+                std::size_t in_flight = 0;         // requests read but not yet answered
+                bool dropped = false;              // backlog overflowed; nothing more is sent
+
+                ~connection();
+            };
+
+            struct pending {
+                std::shared_ptr<connection> conn;
+                request_frame req;
+                std::chrono::steady_clock::time_point arrived;
+            };
+
+            struct session {
+                std::vector<play::play_event> history;
+                std::unique_ptr<model::kv_cache> cache;
+                std::size_t cached = 0;   // history plays the cache is up to date with
+                std::chrono::steady_clock::time_point last_used;
+            };
+
+            void read_loop(std::shared_ptr<connection> conn);
+            void send_reply(connection& conn, const response_frame& resp);
+            void reap_connections();
+            void batch_loop();
+            void run_batch(std::vector<pending>& batch);
+            void run_wave();
+            void end_session(std::unordered_map<std::uint32_t, session>::iterator it);
+            void evict_idle_sessions();
+            std::size_t window() const noexcept;
+
+            model::transformer model_;
+            server_options opts_;
+            model::workspace ws_;
+
+            std::atomic<bool> stop_{false};
+            int listen_fd_ = -1;
+
+            std::mutex queue_mutex_;
+            std::condition_variable queue_cv_;
+            std::deque<pending> queue_;
+
+            // Only touched by the batch thread.
+            std::unordered_map<std::uint32_t, session> sessions_;
+            std::vector<std::unique_ptr<model::kv_cache>> free_caches_;
+            std::chrono::steady_clock::time_point next_sweep_;
+            std::vector<std::size_t> batch_wave_;
+            std::vector<model::prediction> batch_out_;
+            std::vector<char> batch_ok_;
+
+            // One wave = at most one play per game, split into plays that extend a
+            // cache and games whose cache has to be rebuilt from a window.
+            std::vector<std::size_t> decode_idx_;
+            std::vector<session*> decode_sessions_;
+            std::vector<play::play_event> decode_plays_;
+            std::vector<model::kv_cache*> decode_caches_;
+            std::vector<model::prediction> decode_out_;
+            std::vector<std::size_t> prefill_idx_;
+            std::vector<session*> prefill_sessions_;
+            std::vector<std::span<const play::play_event>> prefill_games_;
+            std::vector<model::kv_cache*> prefill_caches_;
+            std::vector<model::prediction> prefill_out_;
+
+            mutable std::mutex stats_mutex_;
+            std::vector<double> latencies_us_;
+            std::atomic<std::size_t> batches_{0};
+            std::atomic<std::size_t> live_sessions_{0};
+
+            mutable std::mutex conn_mutex_;
+            std::vector<std::shared_ptr<connection>> conns_;
+            std::vector<std::jthread> readers_;   // readers_[i] serves conns_[i]
+    };
+}
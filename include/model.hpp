@@ -0,0 +1,207 @@
+#pragma once
+#include "tensor.hpp"
+#include "play.hpp"
+#include "checkpoint.hpp"
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace hml::model {
+    struct config {
+        std::size_t d_model = 64;
+        std::size_t n_heads = 4;
+        std::size_t n_layers = 2;
+        std::size_t d_ff = 256;
+        std::size_t max_seq = 1024;
+    };
+
+    struct prediction {
+        float win_prob = 0.5f;                              // home team wins
+        std::array<float, play::vocab_size> next_event{};   // indexed by play::event_index
+    };
+
+    // Scratch buffers for transformer::forward, allocated once for the largest
+    // batch the caller will run so the forward pass itself never allocates.
+    class workspace {
+        public:
+            workspace(const config& cfg, std::size_t max_games, std::size_t max_tokens);
+
+            std::size_t max_games() const noexcept;
+            std::size_t max_tokens() const noexcept;
+
+        private:
+            friend class transformer;
+
+            std::size_t max_games_;
+            std::size_t max_tokens_;
+            tensor::tensor feats_;   // [tokens, num_features]
+            tensor::tensor x_;       // [tokens, d_model] residual stream
+            tensor::tensor h_;       // [tokens, d_model]
+            tensor::tensor qkv_;     // [tokens, 3 * d_model]
+            tensor::tensor att_;     // [tokens, d_model]
+            tensor::tensor ff_;      // [tokens, d_ff]
+            tensor::tensor last_;    // [games, d_model]
+            tensor::tensor logits_;  // [games, vocab_size]
+            std::vector<std::size_t> offsets_;
+            std::vector<std::size_t> token_game_;
+    };
+
+    // Keys and values of every layer for one game's plays so far, so scoring the
+    // next play only needs that play's own projections. Buffers are allocated
+    // once, [n_layers, 2, max_seq, d_model], and reused via clear().
+    class kv_cache {
+        public:
+            explicit kv_cache(const config& cfg);
+
+            std::size_t size() const noexcept;
+            std::size_t capacity() const noexcept;
+            void clear() noexcept;
+
+        private:
+            friend class transformer;
+
+            float* keys(std::size_t layer) noexcept;
+            float* values(std::size_t layer) noexcept;
+
+            tensor::tensor kv_;
+            std::size_t max_seq_;
+            std::size_t d_model_;
+            std::size_t len_ = 0;
+    };
+
+    // One training window: consecutive plays of a game, at most max_seq of them,
+    // and whether the home team went on to win that game.
+    struct sample {
+        std::span<const play::play_event> plays;
+        float home_win = 0.0f;
+    };
+
+    // Activations the training forward pass keeps for backward, plus gradient
+    // scratch. Sized for up to max_games samples of at most max_window plays.
+    class train_workspace {
+        public:
+            train_workspace(const config& cfg, std::size_t max_games, std::size_t max_window);
+
+            std::size_t max_games() const noexcept;
+            std::size_t max_window() const noexcept;
+
+        private:
+            friend class transformer;
+
+            struct layer_acts {
+                tensor::tensor x_in;     // [tokens, d] residual stream entering the layer
+                tensor::tensor ln1;      // [tokens, d]
+                tensor::tensor qkv;      // [tokens, 3d]
+                tensor::tensor probs;    // [tokens, heads, max_window] attention weights
+                tensor::tensor att;      // [tokens, d]
+                tensor::tensor x_mid;    // [tokens, d] residual stream after attention
+                tensor::tensor ln2;      // [tokens, d]
+                tensor::tensor ff_pre;   // [tokens, d_ff]
+                tensor::tensor ff_act;   // [tokens, d_ff]
+            };
+
+            std::size_t max_games_;
+            std::size_t max_window_;
+            tensor::tensor feats_;       // [tokens, num_features]
+            std::vector<layer_acts> layers_;
+            tensor::tensor x_;           // [tokens, d] running residual stream, final after the last layer
+            tensor::tensor ln_f_;        // [tokens, d]
+            tensor::tensor logits_;      // [tokens, vocab_size], softmaxed, then the gradient
+            tensor::tensor win_;         // [tokens] win logit, then its gradient
+            tensor::tensor dx_, dh_, dh2_, datt_;   // [tokens, d]
+            tensor::tensor dqkv_;        // [tokens, 3d]
+            tensor::tensor dff_;         // [tokens, d_ff]
+            tensor::tensor ln_scratch_;  // [2 * tokens]
+            std::vector<std::size_t> offsets_;
+            std::vector<std::size_t> types_;
+    };
+
+    // Decoder-only transformer over a game's plays: token embedding of the event
+    // type plus a projection of play::encode_features, learned positions, pre-norm
+    // causal attention blocks, and win / next-event heads on the last play.
+    class transformer {
+        public:
+            explicit transformer(const config& cfg, std::uint64_t seed = 0x5eed);
+
+            static transformer load(const std::string& path);
+            void save(const std::string& path) const;
+
+            const config& get_config() const noexcept;
+
+            // Scores the latest play of each game. Games longer than max_seq use
+            // their last max_seq plays. Throws if the batch does not fit in ws.
+            void forward(std::span<const std::span<const play::play_event>> games, workspace& ws,
+                         std::span<prediction> out) const;
+
+            // forward() that also leaves each game's keys/values in caches[g],
+            // replacing whatever they held.
+            void prefill(std::span<const std::span<const play::play_event>> games, std::span<kv_cache* const> caches,
+                         workspace& ws, std::span<prediction> out) const;
+
+            // Appends plays[b] to caches[b] and scores it, attending over the cached
+            // plays only. Costs one token per game regardless of how long the game
+            // is. Matches forward() over the full history while the cache has room;
+            // throws once a cache holds max_seq plays (prefill a shorter window then).
+            void decode(std::span<const play::play_event> plays, std::span<kv_cache* const> caches,
+                        workspace& ws, std::span<prediction> out) const;
+
+            // Gathers every parameter into one contiguous buffer, in checkpoint
+            // order, and points the tensors at it, so optimizers and gradient
+            // exchange can treat the model as a single array. No-op when already flat.
+            void flatten();
+            // The flat buffer; empty until flatten().
+            std::span<float> parameters() noexcept;
+            std::span<const float> parameters() const noexcept;
+
+            // A flattened model of the same shape with every value zero, used to hold gradients.
+            transformer zeros_like() const;
+
+            // Called with a range [begin, end) of parameters() whose gradients are final.
+            using ready_fn = std::function<void(std::size_t begin, std::size_t end)>;
+
+            // Training loss over the batch: mean win log loss over every play plus mean
+            // next-event cross entropy over every play but the last of each window.
+            // Adds its gradient into grads (a zeros_like() model; the caller zeroes it
+            // between steps). Backward reports finished ranges of the flat gradient to
+            // on_ready as it goes: output heads first, then each layer from the top,
+            // then the embeddings, so gradient exchange can start before backward ends.
+            float train_batch(std::span<const sample> batch, train_workspace& ws, transformer& grads,
+                              const ready_fn& on_ready = {}) const;
+
+        private:
+            struct layer {
+                tensor::tensor ln1_g, ln1_b;
+                tensor::tensor w_qkv, b_qkv;   // [d, 3d], [3d]
+                tensor::tensor w_o, b_o;       // [d, d], [d]
+                tensor::tensor ln2_g, ln2_b;
+                tensor::tensor w_ff1, b_ff1;   // [d, d_ff], [d_ff]
+                tensor::tensor w_ff2, b_ff2;   // [d_ff, d], [d]
+            };
+
+            transformer() = default;
+            void allocate();
+            void run(std::span<const std::span<const play::play_event>> games, std::span<kv_cache* const> caches,
+                     workspace& ws, std::span<prediction> out) const;
+            bool fits(const kv_cache& c) const noexcept;
+            void mlp(const layer& l, workspace& ws, std::size_t rows) const;
+            void predict(workspace& ws, std::span<prediction> out) const;
+            template <class Self, class Fn>
+            static void visit(Self& self, Fn&& fn);
+            bool is_flat() const noexcept;
+            std::size_t offset_of(const tensor::tensor& t) const noexcept;
+
+            config cfg_;
+            tensor::tensor embed_;             // [vocab, d]
+            tensor::tensor pos_;               // [max_seq, d]
+            tensor::tensor w_in_, b_in_;       // [num_features, d], [d]
+            std::vector<layer> layers_;
+            tensor::tensor ln_f_g_, ln_f_b_;
+            tensor::tensor w_win_, b_win_;     // [d, 1], [1]
+            tensor::tensor w_next_, b_next_;   // [d, vocab], [vocab]
+            std::shared_ptr<std::vector<float>> flat_;
+    };
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+
+// Raw kernels used by the model forward pass. They read and write caller-owned
+// buffers (usually tensor::data()) so a forward pass never allocates.
+namespace hml::nn {
+    // y[n, out] = x[n, in] @ w[in, out] + b[out]; b may be null.
+    void linear(const float* x, const float* w, const float* b, float* y,
+                std::size_t n, std::size_t in, std::size_t out);
+
+    // Row-wise layer norm over the last dim d.
+    void layer_norm(const float* x, const float* gamma, const float* beta, float* y,
+                    std::size_t n, std::size_t d);
+
+    // tanh approximation, in place.
+    void gelu(float* x, std::size_t n);
+
+    // y += x
+    void add(float* y, const float* x, std::size_t n);
+
+    // Softmax over a single row, in place.
+    void softmax(float* x, std::size_t n);
+
+    // Single-query attention for one head: out = softmax(q . k_j / sqrt(head_dim)) @ v
+    // over j < len. Keys and values are rows `stride` floats apart. scratch holds len floats.
+    void attend(const float* q, const float* k, const float* v, std::size_t stride, std::size_t len,
+                std::size_t head_dim, float* out, float* scratch);
+
+    // Backward passes. Parameter gradients (dw, db, dgamma, dbeta) accumulate so a
+    // caller can zero them once per step; input gradients are overwritten.
+
+    // dw[in, out] += x^T @ dy, db[out] += column sums of dy (db may be null).
+    void linear_backward_params(const float* x, const float* dy, float* dw, float* db,
+                                std::size_t n, std::size_t in, std::size_t out);
+
+    // dx[n, in] = dy[n, out] @ w^T
+    void linear_backward_input(const float* dy, const float* w, float* dx,
+                               std::size_t n, std::size_t in, std::size_t out);
+
+    // Layer norm backward from the forward input x. scratch holds 2 * n floats.
+    void layer_norm_backward(const float* x, const float* gamma, const float* dy, float* dx,
+                             float* dgamma, float* dbeta, std::size_t n, std::size_t d, float* scratch);
+
+    // dy *= gelu'(x), where x is the input gelu() saw.
+    void gelu_backward(const float* x, float* dy, std::size_t n);
+
+    // Causal self-attention backward for one head over one sequence of len rows.
+    // probs holds each query's softmax weights (row t has t + 1 entries, rows
+    // prob_stride apart) as left by attend(); q/k/v and dq/dk/dv are rows `stride`
+    // apart, dout rows `out_stride` apart. dq, dk and dv are overwritten.
+    void attend_backward(const float* q, const float* k, const float* v, const float* probs, std::size_t prob_stride,
+                         const float* dout, std::size_t out_stride, std::size_t stride, std::size_t len,
+                         std::size_t head_dim, float* dq, float* dk, float* dv, float* scratch);
+}
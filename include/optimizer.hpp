@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Optimizers over a model's flat parameter buffer (transformer::parameters()).
+// Each step is one fused pass: gradient clipping, weight decay, the moment
+// updates and the parameter write happen per element in the same loop, which
+// is vectorised and split across the shared pool, instead of a chain of
+// whole-buffer tensor operations. Clipping adds one read-only pass first to
+// find the gradient norm.
+namespace hml::optim {
+    enum class method { sgd, adam, adamw };
+
+    // "sgd", "adam" or "adamw". Throws std::invalid_argument otherwise.
+    method parse_method(std::string_view name);
+
+    struct options {
+        method type = method::adamw;
+        float lr = 1e-3f;
+        float momentum = 0.9f;      // sgd; 0 for plain SGD
+        float beta1 = 0.9f;         // adam / adamw
+        float beta2 = 0.999f;
+        float eps = 1e-8f;
+        float weight_decay = 0.0f;  // L2 added to the gradient for sgd / adam, decoupled for adamw;
+                                    // hits every parameter, LayerNorm gains and biases included
+        float clip_norm = 0.0f;     // rescale the gradient to at most this global L2 norm; 0 disables
+    };
+
+    class optimizer {
+        public:
+            // State for size parameters; moments start at zero.
+            optimizer(std::size_t size, const options& opts);
+
+            // Updates params in place from grads; both must hold size() floats.
+            // Returns the gradient's L2 norm before clipping when clip_norm is
+            // set, 0 otherwise. With clip_norm set, a gradient whose norm is inf or
+            // NaN throws std::runtime_error and leaves params and state untouched.
+            float step(std::span<float> params, std::span<const float> grads);
+
+            std::size_t size() const noexcept;
+            std::uint64_t steps() const noexcept;
+            const options& get_options() const noexcept;
+            void set_lr(float lr) noexcept;
+
+        private:
+            options opts_;
+            std::size_t size_;
+            std::uint64_t steps_ = 0;
+            std::vector<float> m_;   // momentum buffer (sgd) or first moment (adam)
+            std::vector<float> v_;   // second moment (adam)
+    };
+
+    // Global L2 norm of grads, computed in parallel.
+    float l2_norm(std::span<const float> grads);
+}
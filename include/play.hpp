@@ -0,0 +1,81 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+#include <nlohmann/json_fwd.hpp>
+
+namespace hml::play {
+    // NHL API typeCode values we model; anything else maps to index 0.
+    inline constexpr std::array<std::uint16_t, 16> event_types = {
+        502, // faceoff
+        503, // hit
+        504, // giveaway
+        505, // goal
+        506, // shot-on-goal
+        507, // missed-shot
+        508, // blocked-shot
+        509, // penalty
+        510, // stoppage
+        516, // delayed-penalty
+        520, // period-start
+        521, // period-end
+        523, // shootout-complete
+        524, // game-end
+        525, // takeaway
+        535, // failed-shot-attempt
+    };
+    inline constexpr std::uint16_t game_end_code = 524;
+    inline constexpr std::size_t vocab_size = event_types.size() + 1;
+    inline constexpr std::size_t num_features = 12;
+
+    enum class zone : std::uint8_t { none = 0, offensive = 1, defensive = 2, neutral = 3 };
+
+    enum flags : std::uint8_t {
+        has_coords = 1 << 0,
+        has_score = 1 << 1,
+    };
+
+    // One play, flattened from the JSON the NHL API returns. Plain old data so
+    // it can go over a socket or into a column file as-is.
+    struct play_event {
+        std::uint32_t game_id = 0;
+        std::int32_t event_id = 0;
+        std::int32_t team_id = 0;      // details.eventOwnerTeamId
+        std::int32_t player_id = 0;    // shooter / scorer / hitter / winner, whichever is present
+        std::uint16_t type_code = 0;
+        std::uint16_t seconds = 0;     // elapsed in period
+        std::int16_t x = 0;            // details.xCoord, feet from centre ice
+        std::int16_t y = 0;            // details.yCoord
+        std::uint16_t situation = 0;   // situationCode, e.g. 1551
+        std::uint8_t period = 0;
+        zone zone_code = zone::none;
+        std::uint8_t home_score = 0;
+        std::uint8_t away_score = 0;
+        std::uint8_t flags = 0;
+        std::uint8_t reserved = 0;
+    };
+    static_assert(sizeof(play_event) == 32);
+
+    std::size_t event_index(std::uint16_t type_code) noexcept;
+
+    // Parses one entry of the "plays" array. game_id is left for the caller.
+    play_event parse_play(const nlohmann::json& play);
+
+    // Appends p to a game's history, carrying the score forward when p has none.
+    void append_play(std::vector<play_event>& history, play_event p);
+
+    // Reads one {year}_{year+1}_pbp.bin file written by GetData. The file does not
+    // record game numbers, so game ids are assigned as {year}02{index} in file order.
+    // Returns an empty vector if the file cannot be opened.
+    std::vector<std::vector<play_event>> read_season(const std::string& path, int year);
+
+    // A plausible-looking random game for tests and load generation when no
+    // season files are available.
+    std::vector<play_event> synthetic_game(std::uint32_t game_id, std::size_t num_plays, std::uint64_t seed);
+
+    // Writes num_features floats describing p for the model input.
+    void encode_features(const play_event& p, float* out) noexcept;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "play.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Column file layout (little endian), one file per season:
+//
+//   header   "HMLCOLS\0" | u32 version | u32 year | u64 rows | u64 padded_rows | u32 num_columns | u32 0
+//   columns  num_columns x { u8 column | u8 width | u16 0 | u32 0 | u64 offset }
+//   data     each column's padded_rows values at `offset`, 64 byte aligned
+//
+// padded_rows is rows rounded up to a multiple of 64 with zero fill, so scans can
+// always work on whole 64-row words.
+namespace hml::store {
+    inline constexpr char magic[8] = {'H', 'M', 'L', 'C', 'O', 'L', 'S', '\0'};
+    inline constexpr std::uint32_t version = 1;
+    inline constexpr std::size_t alignment = 64;
+    inline constexpr std::size_t row_block = 64;
+
+    enum class column : std::uint8_t {
+        game, event, team, player, type, seconds, x, y, situation,
+        period, zone, home_score, away_score, flags, net_dist,
+        season, // not stored; every row of a file has the file's year
+    };
+    inline constexpr std::size_t num_columns = static_cast<std::size_t>(column::season) + 1;
+
+    struct column_info {
+        std::string_view name;
+        std::uint8_t width;   // bytes per value, 0 for season
+        bool is_signed;
+    };
+
+    inline constexpr std::array<column_info, num_columns> columns = {{
+        {"game", 4, false},
+        {"event", 4, true},
+        {"team", 4, true},
+        {"player", 4, true},
+        {"type", 2, false},
+        {"seconds", 2, false},
+        {"x", 2, true},
+        {"y", 2, true},
+        {"situation", 2, false},
+        {"period", 1, false},
+        {"zone", 1, false},
+        {"home_score", 1, false},
+        {"away_score", 1, false},
+        {"flags", 1, false},
+        {"net_dist", 1, false},
+        {"season", 0, false},
+    }};
+
+    inline const column_info& info(column c) { return columns[static_cast<std::size_t>(c)]; }
+    std::optional<column> find_column(std::string_view name);
+
+    // Feet from the play to the nearer goal line net (x = +-89, y = 0), capped
+    // at 254. 255 when the play has no coordinates.
+    std::uint8_t net_distance(const play::play_event& p) noexcept;
+
+    // {dir}/{year}_{year+1}_pbp.bin and the column file built from it.
+    std::string pbp_path(const std::string& dir, int year);
+    std::string season_path(const std::string& dir, int year);
+
+    // Writes every play of every game as one column file, via a temporary file
+    // renamed over path, so path is never left half written. Throws
+    // std::runtime_error on I/O failure.
+    void write_season(const std::string& path, int year, const std::vector<std::vector<play::play_event>>& games);
+
+    // A read-only mapping of one column file. Copies share the mapping.
+    class season {
+        public:
+            static season open(const std::string& path);
+
+            int year() const noexcept { return year_; }
+            std::size_t rows() const noexcept { return rows_; }
+            std::size_t padded_rows() const noexcept { return padded_rows_; }
+
+            // padded_rows() values of the column's stored type; nullptr for column::season.
+            const void* data(column c) const noexcept { return data_[static_cast<std::size_t>(c)]; }
+
+            template <class T>
+            const T* get(column c) const {
+                return static_cast<const T*>(data(c));
+            }
+
+            // Row r back as a play (net_dist is dropped).
+            play::play_event row(std::size_t r) const;
+
+        private:
+            std::shared_ptr<const void> mapping_;
+            std::array<const void*, num_columns> data_{};
+            int year_ = 0;
+            std::size_t rows_ = 0;
+            std::size_t padded_rows_ = 0;
+    };
+
+    // Opens {dir}/{year}_{year+1}_plays.col for each year in [first, last],
+    // ingesting it from the pbp file first when the column file is missing or
+    // older. Seasons with neither file are skipped with a warning. Ingest and
+    // open run one season per task on the shared pool.
+    std::vector<season> open_seasons(const std::string& dir, int first, int last);
+}
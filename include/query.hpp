@@ -0,0 +1,74 @@
+#pragma once
+#include "play_store.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Filter / group-by / aggregate queries over season column files.
+//
+// A scan splits every season into blocks of rows, filters each block into a
+// bitmap with vectorised range compares, then folds the surviving rows into a
+// per-task hash table keyed on the group-by columns. Blocks from all seasons
+// run on the shared pool and their tables are merged at the end.
+namespace hml::query {
+    // column value in any of [lo, hi] (inclusive), or in none of them when negate is set.
+    struct predicate {
+        store::column col;
+        std::vector<std::pair<std::int64_t, std::int64_t>> ranges;
+        bool negate = false;
+    };
+
+    enum class op : std::uint8_t { count, sum, avg, min, max };
+
+    struct aggregate {
+        op fn = op::count;
+        store::column col = store::column::game;   // ignored for count
+    };
+
+    inline constexpr std::size_t max_group_columns = 4;
+
+    struct query {
+        std::vector<predicate> where;                 // all must hold
+        std::vector<store::column> group_by;          // at most max_group_columns
+        std::vector<aggregate> select;
+    };
+
+    struct result {
+        std::vector<store::column> keys;
+        std::vector<aggregate> aggregates;
+        std::size_t groups = 0;
+        std::vector<std::int64_t> key_values;         // groups x keys.size()
+        std::vector<double> values;                   // groups x aggregates.size()
+        std::size_t rows_scanned = 0;
+        std::size_t rows_matched = 0;
+    };
+
+    // Groups come back sorted by key.
+    result run(const std::vector<store::season>& seasons, const query& q);
+
+    // Sorts groups by aggregate `index` (descending unless ascending is set) and keeps the first `limit`.
+    void order_by(result& r, std::size_t index, bool ascending = false, std::size_t limit = 0);
+
+    // "type=505,506" "net_dist<=25" "period!=4" "x=25..89" "situation=1551"
+    // Throws std::invalid_argument for unknown columns or malformed input.
+    predicate parse_predicate(std::string_view text);
+
+    // "count" "avg:net_dist" "max:seconds"
+    aggregate parse_aggregate(std::string_view text);
+
+    std::string describe(const aggregate& a);
+
+    // Sets the bit for every value in [lo, hi]. n must be a multiple of 64 and
+    // bits holds n / 64 words, overwritten.
+    template <class T>
+    void match_range(const T* values, std::size_t n, T lo, T hi, std::uint64_t* bits);
+
+    namespace detail {
+        // Portable reference for match_range; the vector paths must agree with it.
+        template <class T>
+        void match_range_scalar(const T* values, std::size_t n, T lo, T hi, std::uint64_t* bits);
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "play.hpp"
+#include "play_store.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Grid file layout (little endian), one per season next to its column file:
+//
+//   header   "HMLGRID\0" | u32 version | u32 year | u64 season_rows | u64 points | u64 players
+//   sections 10 x { u64 offset | u64 bytes }, in the order of grid_index's arrays
+//   data     each section at `offset`, 64 byte aligned
+//
+// Only plays with coordinates are indexed. Row ids point back into the season's
+// column file.
+namespace hml::spatial {
+    inline constexpr char magic[8] = {'H', 'M', 'L', 'G', 'R', 'I', 'D', '\0'};
+    inline constexpr std::uint32_t version = 2;
+
+    // 5 ft cells over x in [-100, 100), y in [-45, 45); coordinates outside are clamped
+    // into the border cells. The grid is symmetric about centre ice.
+    inline constexpr int cell_feet = 5;
+    inline constexpr int x_min = -100;
+    inline constexpr int y_min = -45;
+    inline constexpr std::size_t grid_x = 40;
+    inline constexpr std::size_t grid_y = 18;
+    inline constexpr std::size_t num_cells = grid_x * grid_y;
+
+    inline std::size_t cell_of(int x, int y) noexcept {
+        const int cx = std::min(std::max((x - x_min) / cell_feet, 0), static_cast<int>(grid_x) - 1);
+        const int cy = std::min(std::max((y - y_min) / cell_feet, 0), static_cast<int>(grid_y) - 1);
+        return static_cast<std::size_t>(cy) * grid_x + static_cast<std::size_t>(cx);
+    }
+
+    // The cell of (x, y) with every play attacking the net at positive x: plays in
+    // the other half are point-reflected through centre ice first. Cells are
+    // half-open, so reflecting the cell index instead would put x = -5 and x = 5
+    // in different columns. A play and its mirror image always share a cell.
+    inline std::size_t folded_cell_of(int x, int y) noexcept {
+        return x < 0 || (x == 0 && y < 0) ? cell_of(-x, -y) : cell_of(x, y);
+    }
+
+    // Bit i set selects play::event_index() == i.
+    using type_mask = std::uint32_t;
+    inline constexpr type_mask all_types = (type_mask{1} << play::vocab_size) - 1;
+    type_mask mask_of(std::initializer_list<std::uint16_t> type_codes);
+    type_mask mask_of(std::span<const std::uint16_t> type_codes);
+
+    // Inclusive bounds in rink feet.
+    struct rect {
+        int x0, y0, x1, y1;
+    };
+
+    struct neighbour {
+        std::uint32_t row;
+        float distance;
+    };
+
+    // Per-cell counts, grid_y rows of grid_x cells.
+    using heatmap = std::vector<std::uint32_t>;
+
+    std::string grid_path(const std::string& dir, int year);
+
+    class grid_index {
+        public:
+            // Buckets every play of the season that has coordinates.
+            static grid_index build(const store::season& s);
+            static grid_index open(const std::string& path);
+            // Writes a temporary file and renames it over path, so readers never see
+            // a partial index. Throws std::runtime_error on I/O failure.
+            void save(const std::string& path) const;
+
+            int year() const noexcept { return year_; }
+            std::size_t season_rows() const noexcept { return season_rows_; }
+            std::size_t points() const noexcept { return rows_.size(); }
+
+            // Rows inside r whose type is in `types`, in cell order.
+            void region(const rect& r, type_mask types, std::vector<std::uint32_t>& out) const;
+            // Same count as region(r).size(), but cells wholly inside r are read from the
+            // precomputed per-type counts instead of being visited.
+            std::size_t count(const rect& r, type_mask types) const;
+            // The k closest plays to (x, y) whose type is in `types`, nearest first.
+            std::vector<neighbour> nearest(float x, float y, std::size_t k, type_mask types) const;
+
+            // Adds this season's counts into map (resized to num_cells if empty). With
+            // fold, plays are counted in folded_cell_of() so every play attacks the
+            // same net.
+            void add_heatmap(type_mask types, bool fold, heatmap& map) const;
+            void add_player_heatmap(std::int32_t player_id, type_mask types, bool fold, heatmap& map) const;
+
+        private:
+            struct owned;
+
+            std::shared_ptr<const void> storage_;
+            int year_ = 0;
+            std::size_t season_rows_ = 0;
+
+            // Points in cell order: cell c holds [cell_start_[c], cell_start_[c + 1]).
+            std::span<const std::uint32_t> cell_start_;
+            std::span<const std::uint32_t> rows_;
+            std::span<const std::int16_t> x_;
+            std::span<const std::int16_t> y_;
+            std::span<const std::uint8_t> type_;
+            // counts_[t * num_cells + c]: plays of event index t in cell c.
+            std::span<const std::uint32_t> counts_;
+            // The same, by folded_cell_of().
+            std::span<const std::uint32_t> folded_counts_;
+            // Sorted player ids; player i owns entries [player_start_[i], player_start_[i + 1]).
+            std::span<const std::int32_t> players_;
+            std::span<const std::uint32_t> player_start_;
+            // One (folded cell, cell, event index) triple per point, packed as
+            // folded << 18 | cell << 8 | type.
+            std::span<const std::uint32_t> player_points_;
+    };
+
+    // Opens {dir}/{year}_{year+1}_plays.grid for every season, building and saving
+    // it first when it is missing or out of date with the season. One season per
+    // task on the shared pool; the result lines up with `seasons`. A failed save
+    // keeps that index in memory with a warning; a failed build is rethrown once
+    // every season is done.
+    std::vector<grid_index> open_indexes(const std::string& dir, const std::vector<store::season>& seasons);
+}
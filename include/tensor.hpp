@@ -4,14 +4,57 @@
 #include <initializer_list>
 #include <cstddef>
 #include <span>
+#include <memory>
+#include <new>
+#include <utility>
 
 namespace hml::tensor {
+    namespace detail {
+        // Storage for tensor elements: 64 byte aligned, like checkpoint data, so
+        // kernels can write whole cache lines with streaming stores. Buffers of
+        // 2 MB or more are put on huge pages where the OS allows it, which makes
+        // first touch of a fresh result several times cheaper.
+        void* allocate_storage(std::size_t bytes);
+        void free_storage(void* p, std::size_t bytes) noexcept;
+
+        // Elements added without a value (resize) are left uninitialized;
+        // callers that need zeros ask for them.
+        template <class T>
+        struct aligned_allocator {
+            using value_type = T;
+
+            aligned_allocator() noexcept = default;
+            template <class U>
+            aligned_allocator(const aligned_allocator<U>&) noexcept {}
+
+            T* allocate(std::size_t n) { return static_cast<T*>(allocate_storage(n * sizeof(T))); }
+            void deallocate(T* p, std::size_t n) noexcept { free_storage(p, n * sizeof(T)); }
+
+            template <class U>
+            void construct(U* p) noexcept { ::new (static_cast<void*>(p)) U; }
+            template <class U, class... Args>
+            void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+
+            template <class U>
+            bool operator==(const aligned_allocator<U>&) const noexcept { return true; }
+        };
+    }
+
     class tensor {
         public:
             tensor() noexcept;
             explicit tensor(std::span<const std::size_t> dims);
             tensor(std::initializer_list<std::size_t> args);
 
+            tensor(const tensor& x);
+            tensor(tensor&& x) noexcept;
+            tensor& operator=(const tensor& x);
+            tensor& operator=(tensor&& x) noexcept;
+
+            // Wraps memory the tensor does not own (e.g. a mapped checkpoint) without
+            // copying. `owner` is kept alive for as long as the tensor points at `data`.
+            static tensor from_external(std::span<const std::size_t> dims, float* data, std::shared_ptr<void> owner);
+
             tensor operator+(const tensor& x) const;
             tensor operator+(float x) const;
             
@@ -37,14 +80,19 @@ namespace hml::tensor {
             tensor& operator/=(float x);
 
             tensor transpose() const;	
+            tensor contiguous() const;
 
             tensor matmul(const tensor& x) const;
+
+            float sum() const;
+            float mean() const;
             
             std::size_t ndim() const;
             std::size_t numel() const;
             const std::vector<std::size_t>& get_shape() const noexcept;
-            const std::vector<float>& get_data() const noexcept;
+            std::span<const float> get_data() const noexcept;
             bool is_contiguous() const;
+            bool is_external() const noexcept;
 
             const float* data() const noexcept;
             float* data() noexcept;
@@ -56,9 +104,19 @@ namespace hml::tensor {
             tensor& permute(std::span<const std::size_t> axes);
 
         private:
-                std::vector<float> data_;
+                // Like tensor(dims) but skips zeroing, for results every element
+                // of which is written before it is read.
+                static tensor uninitialized(std::span<const std::size_t> dims);
+                std::size_t set_layout(std::span<const std::size_t> dims);
+
+                std::vector<float, detail::aligned_allocator<float>> data_;
                 std::vector<std::size_t> shape_;
                 std::vector<std::size_t> strides_;
 
+                // Non-null when the elements live outside data_ (see from_external).
+                std::shared_ptr<void> owner_;
+                float* external_ = nullptr;
+                std::size_t external_size_ = 0;
+
     };
 }
@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+namespace hml::parallel {
+    // Ranges smaller than this many elements stay on the calling thread.
+    inline constexpr std::size_t default_grain = std::size_t{1} << 15;
+
+    // Grain for loops whose items each cost about `item_cost` elements of work.
+    inline std::size_t grain_for(std::size_t item_cost) {
+        if (item_cost == 0) item_cost = 1;
+        const std::size_t items = default_grain / item_cost;
+        return items == 0 ? 1 : items;
+    }
+
+    class thread_pool {
+        public:
+            explicit thread_pool(std::size_t num_threads);
+            ~thread_pool();
+
+            thread_pool(const thread_pool&) = delete;
+            thread_pool& operator=(const thread_pool&) = delete;
+
+            // Runs fn(0) .. fn(num_tasks - 1) across the workers and the calling
+            // thread, returning once every task has finished. If the pool is already
+            // busy (or this is a worker thread) the tasks run inline instead.
+            // If a task throws, tasks not yet started are skipped and the first
+            // exception is rethrown here once every running task has finished.
+            void run(std::size_t num_tasks, const std::function<void(std::size_t)>& fn);
+
+            std::size_t size() const noexcept;
+
+        private:
+            void worker_loop();
+            void drain() noexcept;
+
+            std::vector<std::jthread> workers_;
+            std::mutex submit_mutex_;
+            std::mutex mutex_;
+            std::condition_variable work_cv_;
+            std::condition_variable done_cv_;
+
+            const std::function<void(std::size_t)>* job_ = nullptr;
+            std::size_t num_tasks_ = 0;
+            std::atomic<std::size_t> next_task_{0};
+            std::size_t active_ = 0;
+            std::size_t generation_ = 0;
+            std::exception_ptr error_;   // first exception thrown by the current run's tasks
+            bool stop_ = false;
+    };
+
+    // Shared pool sized from HML_NUM_THREADS, falling back to hardware_concurrency.
+    thread_pool& default_pool();
+    std::size_t num_threads();
+
+    namespace detail {
+        void parallel_for_impl(std::size_t begin, std::size_t end, std::size_t chunk,
+                               const std::function<void(std::size_t, std::size_t)>& fn);
+    }
+
+    // Calls fn(lo, hi) over disjoint sub-ranges covering [begin, end). Each
+    // sub-range holds at least `grain` elements, so small ranges never leave
+    // the calling thread and never pay for a std::function.
+    template <class Fn>
+    void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, Fn&& fn) {
+        if (end <= begin) return;
+        const std::size_t n = end - begin;
+        if (grain == 0) grain = 1;
+        if (n <= grain || num_threads() <= 1) {
+            fn(begin, end);
+            return;
+        }
+        std::size_t chunks = (n + grain - 1) / grain;
+        if (chunks > num_threads()) chunks = num_threads();
+        detail::parallel_for_impl(begin, end, (n + chunks - 1) / chunks, fn);
+    }
+
+    // Reduces [begin, end) with map(lo, hi) -> T per sub-range and combine(T, T) -> T.
+    // Partials are combined in range order so the result is deterministic for a
+    // given thread count.
+    template <class T, class Map, class Combine>
+    T parallel_reduce(std::size_t begin, std::size_t end, std::size_t grain, T init, Map&& map, Combine&& combine) {
+        if (end <= begin) return init;
+        const std::size_t n = end - begin;
+        if (grain == 0) grain = 1;
+        if (n <= grain || num_threads() <= 1) return combine(init, map(begin, end));
+
+        std::size_t chunks = (n + grain - 1) / grain;
+        if (chunks > num_threads()) chunks = num_threads();
+        const std::size_t chunk = (n + chunks - 1) / chunks;
+        chunks = (n + chunk - 1) / chunk;
+
+        std::vector<T> partials(chunks, init);
+        detail::parallel_for_impl(begin, end, chunk, [&](std::size_t lo, std::size_t hi) {
+            partials[(lo - begin) / chunk] = map(lo, hi);
+        });
+        T out = init;
+        for (const T& p : partials) out = combine(out, p);
+        return out;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "distributed.hpp"
+#include "model.hpp"
+#include "optimizer.hpp"
+#include "play.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Data-parallel training. Every rank holds a full copy of the model and trains
+// on its own shard of games; gradients are averaged over the ring after each
+// step, bucket by bucket while backward is still running, so all ranks apply
+// the same update and stay in lockstep.
+namespace hml::train {
+    struct options {
+        std::string data_dir;               // season column / pbp files; empty for synthetic games
+        int first_season = 2013;            // same range GetData downloads
+        int last_season = 2024;
+        std::size_t synthetic_games = 512;  // when data_dir is empty
+        std::size_t steps = 50;
+        std::size_t batch = 8;              // windows per rank per step
+        std::size_t window = 128;           // plays per window, at most cfg.max_seq
+        std::size_t bucket_kb = 1024;       // gradient bytes per all-reduce
+        std::uint64_t seed = 0x5eed;
+        model::config cfg;
+        optim::options optim;
+    };
+
+    struct report {
+        std::size_t steps = 0;
+        std::size_t samples = 0;            // windows trained on across every rank
+        double seconds = 0.0;               // wall time of the steps
+        double compute_seconds = 0.0;       // forward + backward on this rank
+        double comm_seconds = 0.0;          // gradient all-reduce, mostly hidden behind backward
+        double exposed_seconds = 0.0;       // all-reduce time backward did not hide
+        double optimizer_seconds = 0.0;
+        std::uint64_t bytes_sent = 0;
+        float first_loss = 0.0f;            // averaged over ranks
+        float last_loss = 0.0f;
+
+        double samples_per_second() const noexcept { return seconds > 0.0 ? static_cast<double>(samples) / seconds : 0.0; }
+    };
+
+    // The games rank trains on: game i of the whole set when i % world == rank.
+    // Reads opts.data_dir's seasons in [first_season, last_season], or generates
+    // opts.synthetic_games games when data_dir is empty. Throws if the shard is empty.
+    std::vector<std::vector<play::play_event>> load_shard(const options& opts, std::size_t rank, std::size_t world);
+
+    // Runs opts.steps optimizer steps on model (flattened first) over games, which
+    // should be this rank's shard. Every rank of the ring must call this with
+    // the same model and options.
+    report run(model::transformer& model, const std::vector<std::vector<play::play_event>>& games,
+               const options& opts, dist::ring& ring);
+}
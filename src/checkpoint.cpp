@@ -0,0 +1,172 @@
+#include "../include/checkpoint.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hml::checkpoint {
+    static std::size_t align_up(std::size_t x) { return (x + alignment - 1) & ~(alignment - 1); }
+
+    template <class T>
+    static void put(std::string& out, T v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    static bool sync_file(const std::string& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        const bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+    }
+
+    void save(const std::string& path, const std::vector<entry>& tensors) {
+        // Non-contiguous views have to be written in logical order.
+        std::vector<tensor::tensor> packed(tensors.size());
+        std::vector<const tensor::tensor*> sources(tensors.size());
+        std::unordered_set<std::string> names;
+        for (std::size_t i = 0; i < tensors.size(); i++) {
+            if (tensors[i].second == nullptr) throw std::invalid_argument("checkpoint: null tensor " + tensors[i].first);
+            if (!names.insert(tensors[i].first).second) throw std::invalid_argument("checkpoint: duplicate tensor " + tensors[i].first);
+            sources[i] = tensors[i].second;
+            if (!sources[i]->is_contiguous()) {
+                packed[i] = sources[i]->contiguous();
+                sources[i] = &packed[i];
+            }
+        }
+
+        // Entry sizes are known up front, so the header can be laid out before any data.
+        std::size_t header_size = sizeof(magic) + sizeof(std::uint32_t) * 2 + sizeof(std::uint64_t);
+        for (std::size_t i = 0; i < tensors.size(); i++) {
+            header_size += sizeof(std::uint32_t) + tensors[i].first.size() + 2
+                         + sizeof(std::uint64_t) * (sources[i]->ndim() + 2);
+        }
+
+        std::string header;
+        header.reserve(header_size);
+        header.append(magic, sizeof(magic));
+        put<std::uint32_t>(header, version);
+        put<std::uint32_t>(header, static_cast<std::uint32_t>(tensors.size()));
+        put<std::uint64_t>(header, align_up(header_size));
+
+        std::size_t offset = align_up(header_size);
+        std::vector<std::size_t> offsets(tensors.size());
+        for (std::size_t i = 0; i < tensors.size(); i++) {
+            const auto& name = tensors[i].first;
+            const auto& shape = sources[i]->get_shape();
+            if (shape.size() > 255) throw std::invalid_argument("checkpoint: too many dimensions for " + name);
+            put<std::uint32_t>(header, static_cast<std::uint32_t>(name.size()));
+            header += name;
+            put<std::uint8_t>(header, static_cast<std::uint8_t>(dtype::f32));
+            put<std::uint8_t>(header, static_cast<std::uint8_t>(shape.size()));
+            for (std::size_t d : shape) put<std::uint64_t>(header, d);
+
+            const std::size_t nbytes = sources[i]->size() * sizeof(float);
+            offsets[i] = offset;
+            put<std::uint64_t>(header, offset);
+            put<std::uint64_t>(header, nbytes);
+            offset = align_up(offset + nbytes);
+        }
+
+        // Other processes may have the old file mapped, so it is never truncated in
+        // place: the new one is written beside it and renamed over it, and existing
+        // mappings keep the old contents. The temporary name is per process so two
+        // saves of the same path cannot write into one file.
+        const std::string tmp = path + ".tmp." + std::to_string(::getpid());
+        std::ofstream outfile(tmp, std::ios::binary | std::ios::trunc);
+        if (!outfile) throw std::runtime_error("checkpoint: cannot open " + tmp);
+
+        static const char zeros[alignment] = {};
+        outfile.write(header.data(), static_cast<std::streamsize>(header.size()));
+        std::size_t pos = header.size();
+        for (std::size_t i = 0; i < tensors.size(); i++) {
+            outfile.write(zeros, static_cast<std::streamsize>(offsets[i] - pos));
+            const std::size_t nbytes = sources[i]->size() * sizeof(float);
+            outfile.write(reinterpret_cast<const char*>(sources[i]->data()), static_cast<std::streamsize>(nbytes));
+            pos = offsets[i] + nbytes;
+        }
+        outfile.close();
+        // Data on disk before the rename, so a crash leaves the old file or the whole new one.
+        if (!outfile || !sync_file(tmp) || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("checkpoint: write failed for " + path);
+        }
+    }
+
+    namespace {
+        struct reader {
+            const unsigned char* p;
+            const unsigned char* end;
+
+            template <class T>
+            T get() {
+                if (static_cast<std::size_t>(end - p) < sizeof(T)) throw std::runtime_error("checkpoint: truncated header");
+                T v;
+                std::memcpy(&v, p, sizeof(T));
+                p += sizeof(T);
+                return v;
+            }
+        };
+    }
+
+    std::unordered_map<std::string, tensor::tensor> load(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("checkpoint: cannot open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(magic))) {
+            ::close(fd);
+            throw std::runtime_error("checkpoint: not a checkpoint file " + path);
+        }
+        const std::size_t file_size = static_cast<std::size_t>(st.st_size);
+
+        // MAP_PRIVATE keeps pages shared through the page cache; a write only
+        // copies the touched page for this process and never reaches the file.
+        void* base = ::mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) throw std::runtime_error("checkpoint: mmap failed for " + path);
+        std::shared_ptr<void> mapping(base, [file_size](void* p) { ::munmap(p, file_size); });
+
+        auto* bytes = static_cast<unsigned char*>(base);
+        reader r{bytes, bytes + file_size};
+        if (std::memcmp(r.p, magic, sizeof(magic)) != 0) throw std::runtime_error("checkpoint: bad magic in " + path);
+        r.p += sizeof(magic);
+        if (r.get<std::uint32_t>() != version) throw std::runtime_error("checkpoint: unsupported version in " + path);
+        const std::uint32_t count = r.get<std::uint32_t>();
+        (void)r.get<std::uint64_t>();
+
+        std::unordered_map<std::string, tensor::tensor> out;
+        out.reserve(count);
+        for (std::uint32_t i = 0; i < count; i++) {
+            const std::uint32_t name_len = r.get<std::uint32_t>();
+            if (static_cast<std::size_t>(r.end - r.p) < name_len) throw std::runtime_error("checkpoint: truncated header");
+            std::string name(reinterpret_cast<const char*>(r.p), name_len);
+            r.p += name_len;
+
+            if (r.get<std::uint8_t>() != static_cast<std::uint8_t>(dtype::f32))
+                throw std::runtime_error("checkpoint: unsupported dtype for " + name);
+            const std::uint8_t ndim = r.get<std::uint8_t>();
+            std::vector<std::size_t> shape(ndim);
+            std::size_t numel = 1;
+            for (auto& d : shape) {
+                d = static_cast<std::size_t>(r.get<std::uint64_t>());
+                numel *= d;
+            }
+            const std::size_t offset = static_cast<std::size_t>(r.get<std::uint64_t>());
+            const std::size_t nbytes = static_cast<std::size_t>(r.get<std::uint64_t>());
+
+            if (nbytes != numel * sizeof(float) || offset % alignment != 0 || offset > file_size || nbytes > file_size - offset)
+                throw std::runtime_error("checkpoint: corrupt entry " + name);
+
+            auto* data = reinterpret_cast<float*>(bytes + offset);
+            if (out.contains(name)) throw std::runtime_error("checkpoint: duplicate tensor " + name + " in " + path);
+            out.emplace(std::move(name), tensor::tensor::from_external(shape, data, mapping));
+        }
+        return out;
+    }
+}
@@ -0,0 +1,337 @@
+#include "../include/distributed.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace hml::dist {
+    endpoint endpoint_for(const std::string& address, std::size_t rank) {
+        endpoint ep;
+        if (address.starts_with("unix:")) {
+            ep.path = address.substr(5) + "." + std::to_string(rank);
+            if (ep.path.size() >= sizeof(sockaddr_un::sun_path)) throw std::invalid_argument("dist: socket path too long: " + ep.path);
+            return ep;
+        }
+        if (!address.starts_with("tcp:")) throw std::invalid_argument("dist: address must start with unix: or tcp: (" + address + ")");
+        const std::string rest = address.substr(4);
+        const auto colon = rest.rfind(':');
+        if (colon == std::string::npos || colon == 0) throw std::invalid_argument("dist: tcp address needs host:port (" + address + ")");
+
+        std::vector<std::string> hosts;
+        for (std::size_t start = 0; start <= colon;) {
+            const auto comma = rest.find(',', start);
+            const auto end = comma == std::string::npos || comma > colon ? colon : comma;
+            hosts.push_back(rest.substr(start, end - start));
+            start = end + 1;
+        }
+        const unsigned long base = std::stoul(rest.substr(colon + 1));
+        if (base + rank > 65535) throw std::invalid_argument("dist: port out of range for rank " + std::to_string(rank));
+        ep.unix_socket = false;
+        ep.host = hosts[rank % hosts.size()];
+        ep.port = static_cast<std::uint16_t>(base + rank);
+        return ep;
+    }
+
+    static void close_fd(int& fd) {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    static int connect_to(const endpoint& ep) {
+        if (ep.unix_socket) {
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) return -1;
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, ep.path.c_str(), sizeof(addr.sun_path) - 1);
+            if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+                ::close(fd);
+                return -1;
+            }
+            return fd;
+        }
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        if (::getaddrinfo(ep.host.c_str(), std::to_string(ep.port).c_str(), &hints, &found) != 0) return -1;
+        int fd = -1;
+        for (addrinfo* a = found; a != nullptr && fd < 0; a = a->ai_next) {
+            fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && ::connect(fd, a->ai_addr, a->ai_addrlen) != 0) close_fd(fd);
+        }
+        ::freeaddrinfo(found);
+        return fd;
+    }
+
+    static bool write_all(int fd, const void* buf, std::size_t n) {
+        const char* p = static_cast<const char*>(buf);
+        while (n > 0) {
+            const ssize_t w = ::send(fd, p, n, MSG_NOSIGNAL);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            p += w;
+            n -= static_cast<std::size_t>(w);
+        }
+        return true;
+    }
+
+    static bool read_all(int fd, void* buf, std::size_t n) {
+        char* p = static_cast<char*>(buf);
+        while (n > 0) {
+            const ssize_t r = ::recv(fd, p, n, 0);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            p += r;
+            n -= static_cast<std::size_t>(r);
+        }
+        return true;
+    }
+
+    ring::ring(std::size_t rank, std::size_t world, const std::string& address, std::chrono::milliseconds timeout)
+        : rank_(rank), world_(world) {
+        if (world == 0 || rank >= world) throw std::invalid_argument("dist: rank must be below world size");
+        if (world == 1) return;
+        // The destructor does not run if we throw, so a failed bind, connect or
+        // handshake has to give back whatever sockets it opened itself.
+        try {
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            const endpoint self = endpoint_for(address, rank);
+
+            if (self.unix_socket) {
+                listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                sockaddr_un addr{};
+                addr.sun_family = AF_UNIX;
+                std::strncpy(addr.sun_path, self.path.c_str(), sizeof(addr.sun_path) - 1);
+                ::unlink(self.path.c_str());
+                unix_path_ = self.path;
+                if (listen_fd_ < 0 || ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+                    throw std::runtime_error("dist: cannot bind " + self.path + ": " + std::strerror(errno));
+            } else {
+                listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+                int one = 1;
+                ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                sockaddr_in addr{};
+                addr.sin_family = AF_INET;
+                addr.sin_addr.s_addr = htonl(INADDR_ANY);
+                addr.sin_port = htons(self.port);
+                if (listen_fd_ < 0 || ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+                    throw std::runtime_error("dist: cannot bind port " + std::to_string(self.port) + ": " + std::strerror(errno));
+            }
+            if (::listen(listen_fd_, 4) != 0) throw std::runtime_error(std::string("dist: listen failed: ") + std::strerror(errno));
+
+            // Right neighbour first: connect() completes against the peer's backlog, so
+            // no rank has to accept before it can connect.
+            const endpoint right = endpoint_for(address, (rank + 1) % world);
+            while ((right_fd_ = connect_to(right)) < 0) {
+                if (std::chrono::steady_clock::now() > deadline) throw std::runtime_error("dist: timed out connecting to rank " + std::to_string((rank + 1) % world));
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+            const std::uint32_t me = static_cast<std::uint32_t>(rank);
+            if (!write_all(right_fd_, &me, sizeof(me))) throw std::runtime_error("dist: handshake with right neighbour failed");
+
+            const std::uint32_t expect = static_cast<std::uint32_t>((rank + world - 1) % world);
+            while (left_fd_ < 0) {
+                const auto left_ms = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (left_ms <= 0) throw std::runtime_error("dist: timed out waiting for rank " + std::to_string(expect));
+                pollfd pfd{listen_fd_, POLLIN, 0};
+                if (::poll(&pfd, 1, static_cast<int>(std::min<long long>(left_ms, 1000))) <= 0) continue;
+                int fd = ::accept(listen_fd_, nullptr, nullptr);
+                if (fd < 0) continue;
+                std::uint32_t peer = 0;
+                if (read_all(fd, &peer, sizeof(peer)) && peer == expect) left_fd_ = fd;
+                else ::close(fd);
+            }
+            close_fd(listen_fd_);
+            if (!unix_path_.empty()) ::unlink(unix_path_.c_str());
+            unix_path_.clear();
+
+            for (int fd : {left_fd_, right_fd_}) {
+                if (!self.unix_socket) {
+                    int one = 1;
+                    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                }
+                int buf = 4 << 20;
+                ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf));
+                ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf));
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+            }
+        } catch (...) {
+            close_all();
+            throw;
+        }
+    }
+
+    ring::~ring() { close_all(); }
+
+    void ring::close_all() noexcept {
+        close_fd(left_fd_);
+        close_fd(right_fd_);
+        close_fd(listen_fd_);
+        if (!unix_path_.empty()) ::unlink(unix_path_.c_str());
+        unix_path_.clear();
+    }
+
+    std::size_t ring::rank() const noexcept { return rank_; }
+    std::size_t ring::world() const noexcept { return world_; }
+    std::uint64_t ring::bytes_sent() const noexcept { return bytes_sent_; }
+
+    void ring::exchange(const void* send, std::size_t send_bytes, void* recv, std::size_t recv_bytes) {
+        const char* out = static_cast<const char*>(send);
+        char* in = static_cast<char*>(recv);
+        std::size_t sent = 0;
+        std::size_t got = 0;
+        while (sent < send_bytes || got < recv_bytes) {
+            // A finished direction is left out entirely: poll reports POLLHUP regardless
+            // of events, and a neighbour that is done with the ring may already be gone.
+            pollfd fds[2] = {{sent < send_bytes ? right_fd_ : -1, POLLOUT, 0},
+                             {got < recv_bytes ? left_fd_ : -1, POLLIN, 0}};
+            const int ready = ::poll(fds, 2, 60000);
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready <= 0) throw std::runtime_error("dist: ring exchange timed out");
+
+            if (fds[0].revents & (POLLERR | POLLHUP)) throw std::runtime_error("dist: right neighbour went away");
+            if (fds[0].revents & POLLOUT) {
+                const ssize_t w = ::send(right_fd_, out + sent, send_bytes - sent, MSG_NOSIGNAL);
+                if (w < 0 && errno != EAGAIN && errno != EINTR) throw std::runtime_error(std::string("dist: send failed: ") + std::strerror(errno));
+                if (w > 0) sent += static_cast<std::size_t>(w);
+            }
+            if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                const ssize_t r = ::recv(left_fd_, in + got, recv_bytes - got, 0);
+                if (r == 0) throw std::runtime_error("dist: left neighbour went away");
+                if (r < 0 && errno != EAGAIN && errno != EINTR) throw std::runtime_error(std::string("dist: recv failed: ") + std::strerror(errno));
+                if (r > 0) got += static_cast<std::size_t>(r);
+            }
+        }
+        bytes_sent_ += send_bytes;
+    }
+
+    void ring::all_reduce(std::span<float> data) {
+        if (world_ == 1 || data.empty()) return;
+        const std::size_t n = data.size();
+        const std::size_t w = world_;
+        auto lo = [&](std::size_t c) { return c * n / w; };
+        auto len = [&](std::size_t c) { return lo(c + 1) - lo(c); };
+        if (recv_.size() < n / w + 1) recv_.resize(n / w + 1);
+
+        // Reduce-scatter: after w - 1 steps this rank holds the full sum of chunk rank + 1.
+        for (std::size_t s = 0; s + 1 < w; s++) {
+            const std::size_t send_c = (rank_ + w - s) % w;
+            const std::size_t recv_c = (rank_ + w - s - 1) % w;
+            exchange(data.data() + lo(send_c), len(send_c) * sizeof(float), recv_.data(), len(recv_c) * sizeof(float));
+            float* dst = data.data() + lo(recv_c);
+            for (std::size_t i = 0; i < len(recv_c); i++) dst[i] += recv_[i];
+        }
+        // All-gather: pass the finished chunks around the ring.
+        for (std::size_t s = 0; s + 1 < w; s++) {
+            const std::size_t send_c = (rank_ + 1 + w - s) % w;
+            const std::size_t recv_c = (rank_ + w - s) % w;
+            exchange(data.data() + lo(send_c), len(send_c) * sizeof(float), data.data() + lo(recv_c), len(recv_c) * sizeof(float));
+        }
+    }
+
+    bucket_reducer::bucket_reducer(ring& r, std::size_t bucket_size)
+        : ring_(r), bucket_size_(bucket_size == 0 ? 1 : bucket_size) {
+        if (ring_.world() > 1) worker_ = std::jthread([this] { loop(); });
+    }
+
+    bucket_reducer::~bucket_reducer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    void bucket_reducer::begin(std::span<float> grads) {
+        grads_ = grads;
+        pending_lo_ = pending_hi_ = 0;
+        comm_seconds_ = 0.0;
+        exposed_seconds_ = 0.0;
+    }
+
+    void bucket_reducer::ready(std::size_t begin, std::size_t end) {
+        if (ring_.world() == 1 || begin >= end) return;
+        if (end > grads_.size()) throw std::out_of_range("dist: ready range past the gradient buffer");
+        if (pending_lo_ == pending_hi_) {
+            pending_lo_ = begin;
+            pending_hi_ = end;
+        } else if (end == pending_lo_) {
+            pending_lo_ = begin;
+        } else if (begin == pending_hi_) {
+            pending_hi_ = end;
+        } else {
+            flush();
+            pending_lo_ = begin;
+            pending_hi_ = end;
+        }
+        if (pending_hi_ - pending_lo_ >= bucket_size_) flush();
+    }
+
+    void bucket_reducer::flush() {
+        if (pending_lo_ == pending_hi_) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.emplace_back(pending_lo_, pending_hi_);
+            in_flight_++;
+        }
+        pending_lo_ = pending_hi_ = 0;
+        cv_.notify_one();
+    }
+
+    void bucket_reducer::finish() {
+        if (ring_.world() == 1) return;
+        flush();
+        const auto start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [&] { return in_flight_ == 0; });
+        exposed_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (error_) {
+            auto e = std::exchange(error_, nullptr);
+            std::rethrow_exception(e);
+        }
+    }
+
+    double bucket_reducer::comm_seconds() const noexcept { return comm_seconds_; }
+    double bucket_reducer::exposed_seconds() const noexcept { return exposed_seconds_; }
+
+    void bucket_reducer::loop() {
+        const float scale = 1.0f / static_cast<float>(ring_.world());
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) return;
+            const auto [lo, hi] = queue_.front();
+            queue_.pop_front();
+            const bool failed = error_ != nullptr;
+            lock.unlock();
+
+            // Once the ring has failed the remaining buckets are only drained.
+            const auto start = std::chrono::steady_clock::now();
+            std::exception_ptr err;
+            if (!failed) {
+                try {
+                    auto bucket = grads_.subspan(lo, hi - lo);
+                    ring_.all_reduce(bucket);
+                    for (float& g : bucket) g *= scale;
+                } catch (...) {
+                    err = std::current_exception();
+                }
+            }
+            const double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            lock.lock();
+            comm_seconds_ += took;
+            if (err && !error_) error_ = err;
+            if (--in_flight_ == 0) done_cv_.notify_all();
+        }
+    }
+}
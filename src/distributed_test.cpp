@@ -0,0 +1,260 @@
+// distributed_test.cpp
+// Tests for the ring all-reduce, the bucketed gradient reducer and data-parallel
+// training. Every rank is a forked process talking over real sockets.
+
+#include "../include/distributed.hpp"
+#include "../include/trainer.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <functional>
+#include <filesystem>
+#include <chrono>
+#include <cmath>
+#include <cassert>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+namespace dist = hml::dist;
+namespace model = hml::model;
+
+// Runs fn(rank) in world child processes and asserts that every one succeeded.
+// Children must not inherit a running thread pool, so the parent never uses it.
+static void run_ranks(size_t world, const function<void(size_t)>& fn) {
+    vector<pid_t> children;
+    for (size_t r = 0; r < world; r++) {
+        const pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            try {
+                fn(r);
+            } catch (const std::exception& e) {
+                cerr << "rank " << r << ": " << e.what() << "\n";
+                _exit(1);
+            }
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+}
+
+static string unix_address(const string& name) {
+    return "unix:/tmp/hml_dist_test_" + to_string(getpid()) + "_" + name;
+}
+
+// Small integers, so sums are exact in any order.
+static float value(size_t i, size_t rank) {
+    return static_cast<float>((i * 7 + rank * 13) % 101) - 50.0f;
+}
+
+static void check_all_reduce(size_t world, const string& address) {
+    run_ranks(world, [&](size_t rank) {
+        dist::ring ring(rank, world, address);
+        assert(ring.rank() == rank && ring.world() == world);
+        for (size_t n : {0, 1, 5, 1000, 123457}) {
+            vector<float> data(n);
+            for (size_t i = 0; i < n; i++) data[i] = value(i, rank);
+            ring.all_reduce(data);
+            for (size_t i = 0; i < n; i++) {
+                float want = 0.0f;
+                for (size_t r = 0; r < world; r++) want += value(i, r);
+                assert(data[i] == want);
+            }
+        }
+        assert((ring.bytes_sent() == 0) == (world == 1));
+    });
+}
+
+static void test_endpoints() {
+    cout << "=== test_endpoints ===\n";
+
+    auto u = dist::endpoint_for("unix:/tmp/ring", 3);
+    assert(u.unix_socket && u.path == "/tmp/ring.3");
+    auto t = dist::endpoint_for("tcp:10.0.0.1,10.0.0.2:29500", 3);
+    assert(!t.unix_socket && t.host == "10.0.0.2" && t.port == 29503);
+    auto l = dist::endpoint_for("tcp:localhost:40000", 0);
+    assert(l.host == "localhost" && l.port == 40000);
+
+    bool threw = false;
+    try { dist::endpoint_for("udp:x:1", 0); } catch (const std::invalid_argument&) { threw = true; }
+    assert(threw);
+    threw = false;
+    try { dist::endpoint_for("tcp:host:65535", 1); } catch (const std::invalid_argument&) { threw = true; }
+    assert(threw);
+
+    cout << "OK\n\n";
+}
+
+static size_t open_fds() {
+    size_t n = 0;
+    for ([[maybe_unused]] const auto& e : filesystem::directory_iterator("/proc/self/fd")) n++;
+    return n;
+}
+
+static void test_failed_connect_releases_sockets() {
+    cout << "=== test_failed_connect_releases_sockets ===\n";
+
+    // Rank 0 of 2 with nobody on the other end: it listens, then times out
+    // connecting to rank 1.
+    const string address = unix_address("alone");
+    const size_t before = open_fds();
+    for (int attempt = 0; attempt < 3; attempt++) {
+        bool threw = false;
+        try { dist::ring ring(0, 2, address, chrono::milliseconds(100)); } catch (const std::runtime_error&) { threw = true; }
+        assert(threw);
+    }
+    assert(open_fds() == before);
+    assert(!filesystem::exists(dist::endpoint_for(address, 0).path));
+
+    cout << "OK\n\n";
+}
+
+static void test_all_reduce() {
+    cout << "=== test_all_reduce ===\n";
+
+    for (size_t world = 1; world <= 4; world++) check_all_reduce(world, unix_address("ar" + to_string(world)));
+    check_all_reduce(3, "tcp:127.0.0.1:" + to_string(20000 + getpid() % 20000));
+
+    cout << "OK\n\n";
+}
+
+static void test_bucket_reducer() {
+    cout << "=== test_bucket_reducer ===\n";
+
+    const size_t world = 3, n = 10000;
+    const string address = unix_address("bucket");
+    run_ranks(world, [&](size_t rank) {
+        dist::ring ring(rank, world, address);
+        dist::bucket_reducer reducer(ring, 700);
+        vector<float> grads(n);
+        for (size_t step = 0; step < 3; step++) {
+            for (size_t i = 0; i < n; i++) grads[i] = value(i + step, rank) * 3.0f;
+            reducer.begin(grads);
+            // Back to front in uneven pieces, like backward reports them, plus
+            // one range out of order that starts a new bucket.
+            size_t hi = n;
+            for (size_t k = 0; hi > 2000; k++) {
+                const size_t len = min(hi - 2000, 1 + (k * 389) % 1500);
+                reducer.ready(hi - len, hi);
+                hi -= len;
+            }
+            reducer.ready(0, 1000);
+            reducer.ready(1000, 2000);
+            reducer.finish();
+            for (size_t i = 0; i < n; i++) {
+                float want = 0.0f;
+                for (size_t r = 0; r < world; r++) want += value(i + step, r);
+                assert(grads[i] == want);
+            }
+            assert(reducer.comm_seconds() >= 0.0 && reducer.exposed_seconds() >= 0.0);
+        }
+    });
+
+    cout << "OK\n\n";
+}
+
+static model::config small_config() {
+    model::config cfg;
+    cfg.d_model = 16;
+    cfg.n_heads = 2;
+    cfg.n_layers = 2;
+    cfg.d_ff = 32;
+    cfg.max_seq = 32;
+    return cfg;
+}
+
+static void test_data_parallel_gradient() {
+    cout << "=== test_data_parallel_gradient ===\n";
+
+    // Two ranks with half the batch each must average to the full-batch
+    // gradient. Windows are the same length, so per-rank means average exactly.
+    const size_t world = 2, per_rank = 3, window = 12;
+    const string address = unix_address("grad");
+    run_ranks(world, [&](size_t rank) {
+        vector<vector<hml::play::play_event>> games;
+        vector<model::sample> all;
+        for (uint32_t g = 0; g < world * per_rank; g++) games.push_back(hml::play::synthetic_game(2023020001u + g, 40, g));
+        for (size_t g = 0; g < games.size(); g++) {
+            all.push_back({span<const hml::play::play_event>(games[g]).subspan(g * 2, window), g % 2 ? 1.0f : 0.0f});
+        }
+
+        model::transformer m(small_config(), 7);
+        m.flatten();
+        model::train_workspace ws(small_config(), all.size(), window);
+        auto full = m.zeros_like();
+        m.train_batch(all, ws, full);
+
+        dist::ring ring(rank, world, address);
+        dist::bucket_reducer reducer(ring, 512);
+        auto mine = m.zeros_like();
+        reducer.begin(mine.parameters());
+        m.train_batch(span<const model::sample>(all).subspan(rank * per_rank, per_rank), ws, mine,
+                      [&](size_t b, size_t e) { reducer.ready(b, e); });
+        reducer.finish();
+
+        auto want = full.parameters();
+        auto got = mine.parameters();
+        for (size_t i = 0; i < got.size(); i++) assert(std::fabs(got[i] - want[i]) <= 1e-5f + 1e-4f * std::fabs(want[i]));
+    });
+
+    cout << "OK\n\n";
+}
+
+static void test_ranks_stay_in_sync() {
+    cout << "=== test_ranks_stay_in_sync ===\n";
+
+    hml::train::options opts;
+    opts.synthetic_games = 10;
+    opts.steps = 4;
+    opts.batch = 2;
+    opts.window = 16;
+    opts.optim.lr = 0.01f;
+    opts.optim.clip_norm = 1.0f;
+    opts.bucket_kb = 4;
+    opts.cfg = small_config();
+
+    const size_t world = 2;
+    const string address = unix_address("sync");
+    run_ranks(world, [&](size_t rank) {
+        auto games = hml::train::load_shard(opts, rank, world);
+        assert(games.size() == opts.synthetic_games / world);
+        dist::ring ring(rank, world, address);
+        model::transformer m(opts.cfg, opts.seed);
+        auto rep = hml::train::run(m, games, opts, ring);
+        assert(rep.steps == opts.steps && rep.samples == opts.steps * opts.batch * world);
+        assert(std::isfinite(rep.first_loss) && std::isfinite(rep.last_loss));
+
+        // Ranks trained on different games but applied the same averaged
+        // gradients, so their weights must still match bit for bit.
+        auto params = m.parameters();
+        vector<float> sum(params.begin(), params.end());
+        ring.all_reduce(sum);
+        for (size_t i = 0; i < params.size(); i++) assert(sum[i] == 2.0f * params[i]);
+    });
+
+    cout << "OK\n\n";
+}
+
+int main() {
+    try {
+        test_endpoints();
+        test_failed_connect_releases_sockets();
+        test_all_reduce();
+        test_bucket_reducer();
+        test_data_parallel_gradient();
+        test_ranks_stay_in_sync();
+
+        cout << "ALL TESTS PASSED ✅\n";
+    } catch (const std::exception& e) {
+        cerr << "Unhandled exception: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
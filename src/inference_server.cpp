@@ -0,0 +1,413 @@
+#include "../include/inference_server.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace hml::serving {
+    latency_summary summarize(std::vector<double> samples_us) {
+        latency_summary s;
+        s.count = samples_us.size();
+        if (samples_us.empty()) return s;
+        std::sort(samples_us.begin(), samples_us.end());
+        auto pct = [&](double p) {
+            std::size_t i = static_cast<std::size_t>(p * static_cast<double>(samples_us.size() - 1) + 0.5);
+            return samples_us[std::min(i, samples_us.size() - 1)];
+        };
+        s.mean_us = std::accumulate(samples_us.begin(), samples_us.end(), 0.0) / static_cast<double>(s.count);
+        s.p50_us = pct(0.50);
+        s.p99_us = pct(0.99);
+        s.max_us = samples_us.back();
+        return s;
+    }
+
+    bool read_full(int fd, void* buf, std::size_t n) {
+        auto* p = static_cast<char*>(buf);
+        while (n > 0) {
+            ssize_t r = ::recv(fd, p, n, 0);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            p += r;
+            n -= static_cast<std::size_t>(r);
+        }
+        return true;
+    }
+
+    bool write_full(int fd, const void* buf, std::size_t n) {
+        auto* p = static_cast<const char*>(buf);
+        while (n > 0) {
+            ssize_t w = ::send(fd, p, n, MSG_NOSIGNAL);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            p += w;
+            n -= static_cast<std::size_t>(w);
+        }
+        return true;
+    }
+
+    // Runs in the member-init list, before anything is sized from the options.
+    static server_options validated(server_options opts) {
+        if (opts.max_batch == 0) throw std::invalid_argument("inference_server: max_batch must be > 0");
+        if (opts.session_idle_ms == 0) throw std::invalid_argument("inference_server: session_idle_ms must be > 0");
+        return opts;
+    }
+
+    inference_server::inference_server(model::transformer model, server_options opts)
+        : model_(std::move(model)), opts_(validated(std::move(opts))),
+          ws_(model_.get_config(), opts_.max_batch, opts_.max_batch * window()) {
+        batch_wave_.reserve(opts_.max_batch);
+        batch_out_.resize(opts_.max_batch);
+        batch_ok_.resize(opts_.max_batch);
+        for (auto* v : {&decode_idx_, &prefill_idx_}) v->reserve(opts_.max_batch);
+        for (auto* v : {&decode_sessions_, &prefill_sessions_}) v->reserve(opts_.max_batch);
+        decode_plays_.reserve(opts_.max_batch);
+        decode_caches_.reserve(opts_.max_batch);
+        decode_out_.resize(opts_.max_batch);
+        prefill_games_.reserve(opts_.max_batch);
+        prefill_caches_.reserve(opts_.max_batch);
+        prefill_out_.resize(opts_.max_batch);
+
+        listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd_ < 0) throw std::runtime_error("inference_server: socket() failed");
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (opts_.socket_path.size() >= sizeof(addr.sun_path)) {
+            ::close(listen_fd_);
+            throw std::invalid_argument("inference_server: socket path too long");
+        }
+        std::strcpy(addr.sun_path, opts_.socket_path.c_str());
+        ::unlink(opts_.socket_path.c_str());
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listen_fd_, 64) != 0) {
+            ::close(listen_fd_);
+            throw std::runtime_error("inference_server: cannot listen on " + opts_.socket_path);
+        }
+    }
+
+    inference_server::~inference_server() {
+        if (listen_fd_ >= 0) ::close(listen_fd_);
+        ::unlink(opts_.socket_path.c_str());
+    }
+
+    inference_server::connection::~connection() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    void inference_server::stop() noexcept { stop_.store(true); }
+
+    std::size_t inference_server::batches() const noexcept { return batches_.load(); }
+
+    std::size_t inference_server::sessions() const noexcept { return live_sessions_.load(); }
+
+    std::size_t inference_server::connections() const {
+        std::lock_guard<std::mutex> lock(conn_mutex_);
+        return conns_.size();
+    }
+
+    latency_summary inference_server::stats() const {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        return summarize(latencies_us_);
+    }
+
+    void inference_server::run() {
+        std::jthread batcher([this] { batch_loop(); });
+
+        while (!stop_.load()) {
+            reap_connections();
+            pollfd pfd{listen_fd_, POLLIN, 0};
+            if (::poll(&pfd, 1, 100) <= 0) continue;
+            int fd = ::accept(listen_fd_, nullptr, nullptr);
+            if (fd < 0) continue;
+            auto conn = std::make_shared<connection>();
+            conn->fd = fd;
+            std::lock_guard<std::mutex> lock(conn_mutex_);
+            conns_.push_back(conn);
+            readers_.emplace_back([this, conn] { read_loop(conn); });
+        }
+
+        // Unblock readers, then let the batcher drain what is already queued.
+        {
+            std::lock_guard<std::mutex> lock(conn_mutex_);
+            for (auto& c : conns_) ::shutdown(c->fd, SHUT_RDWR);
+            readers_.clear();
+        }
+        queue_cv_.notify_all();
+        batcher.join();
+        std::lock_guard<std::mutex> lock(conn_mutex_);
+        conns_.clear();
+    }
+
+    // Joins the readers of connections that have closed and drops the server's
+    // reference to them; the fd closes once no queued request still needs it.
+    void inference_server::reap_connections() {
+        std::lock_guard<std::mutex> lock(conn_mutex_);
+        for (std::size_t i = 0; i < conns_.size();) {
+            if (!conns_[i]->closed.load()) {
+                i++;
+                continue;
+            }
+            readers_[i].join();
+            std::swap(conns_[i], conns_.back());
+            std::swap(readers_[i], readers_.back());
+            conns_.pop_back();
+            readers_.pop_back();
+        }
+    }
+
+    // Sends as much of the outbox as the socket takes without blocking. Returns
+    // false once the peer is gone. Caller holds write_mutex.
+    static bool flush_outbox(int fd, std::string& outbox) {
+        std::size_t sent = 0;
+        while (sent < outbox.size()) {
+            ssize_t w = ::send(fd, outbox.data() + sent, outbox.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (w <= 0) {
+                outbox.clear();
+                return false;
+            }
+            sent += static_cast<std::size_t>(w);
+        }
+        outbox.erase(0, sent);
+        return true;
+    }
+
+    // Called from the batch thread, which must never wait on a client: one that
+    // stops reading would stall every game in the batch.
+    void inference_server::send_reply(connection& conn, const response_frame& resp) {
+        std::lock_guard<std::mutex> lock(conn.write_mutex);
+        conn.in_flight--;
+        if (conn.dropped) return;
+        conn.outbox.append(reinterpret_cast<const char*>(&resp), sizeof(resp));
+        if (!flush_outbox(conn.fd, conn.outbox)) {
+            conn.dropped = true;
+            return;
+        }
+        if (conn.outbox.size() > opts_.max_reply_backlog) {
+            conn.dropped = true;
+            conn.outbox.clear();
+            conn.outbox.shrink_to_fit();
+            ::shutdown(conn.fd, SHUT_RDWR);   // the reader sees EOF and the connection is reaped
+        }
+    }
+
+    // Reads requests and, while the outbox has bytes the batch thread could not
+    // send, pushes them out as the client makes room. A client that only shut
+    // down its sending side still gets every reply before the connection closes.
+    void inference_server::read_loop(std::shared_ptr<connection> conn) {
+        request_frame req;
+        bool reading = true;
+        while (!stop_.load()) {
+            pollfd pfd{conn->fd, static_cast<short>(reading ? POLLIN : 0), 0};
+            {
+                std::lock_guard<std::mutex> lock(conn->write_mutex);
+                if (!reading && (conn->dropped || (conn->in_flight == 0 && conn->outbox.empty()))) break;
+                if (!conn->outbox.empty()) pfd.events |= POLLOUT;
+            }
+            const int ready = ::poll(&pfd, 1, 50);
+            if (ready < 0 && errno != EINTR) break;
+            if (ready <= 0) continue;
+            if (pfd.revents & (POLLOUT | POLLERR | POLLHUP)) {
+                std::lock_guard<std::mutex> lock(conn->write_mutex);
+                // Once we stop reading, a hang-up means nobody is left to answer.
+                if (!flush_outbox(conn->fd, conn->outbox) || (!reading && (pfd.revents & POLLHUP))) conn->dropped = true;
+            }
+            if (!reading || !(pfd.revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            if (!read_full(conn->fd, &req, sizeof(req))) {
+                reading = false;
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> lock(conn->write_mutex);
+                conn->in_flight++;
+            }
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex_);
+                queue_.push_back(pending{conn, req, std::chrono::steady_clock::now()});
+            }
+            queue_cv_.notify_one();
+        }
+        conn->closed.store(true);
+    }
+
+    void inference_server::batch_loop() {
+        std::vector<pending> batch;
+        batch.reserve(opts_.max_batch);
+        next_sweep_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(opts_.session_idle_ms);
+        while (true) {
+            {
+                // Wake up for the next idle sweep even if no requests come in.
+                std::unique_lock<std::mutex> lock(queue_mutex_);
+                queue_cv_.wait_until(lock, next_sweep_, [&] { return !queue_.empty() || stop_.load(); });
+                if (queue_.empty() && stop_.load()) return;
+
+                if (!queue_.empty()) {
+                    // Hold the batch open until it is full or the oldest request has waited max_wait_us.
+                    const auto deadline = queue_.front().arrived + std::chrono::microseconds(opts_.max_wait_us);
+                    queue_cv_.wait_until(lock, deadline, [&] { return queue_.size() >= opts_.max_batch || stop_.load(); });
+
+                    const std::size_t n = std::min(queue_.size(), opts_.max_batch);
+                    for (std::size_t i = 0; i < n; i++) {
+                        batch.push_back(std::move(queue_.front()));
+                        queue_.pop_front();
+                    }
+                }
+            }
+            if (!batch.empty()) run_batch(batch);
+            batch.clear();
+            evict_idle_sessions();
+        }
+    }
+
+    // Plays kept when a game outgrows its cache: half the model's window, so the
+    // rebuild happens at most once every max_seq / 2 plays.
+    std::size_t inference_server::window() const noexcept {
+        return std::max<std::size_t>(1, model_.get_config().max_seq / 2);
+    }
+
+    void inference_server::run_batch(std::vector<pending>& batch) {
+        // A game can show up more than once in a batch; its plays go in successive
+        // waves so each cache only ever grows by one play per decode.
+        batch_wave_.assign(batch.size(), 0);
+        std::size_t waves = 0;
+        for (std::size_t i = 0; i < batch.size(); i++) {
+            for (std::size_t j = 0; j < i; j++) {
+                if (batch[j].req.play.game_id == batch[i].req.play.game_id) batch_wave_[i]++;
+            }
+            waves = std::max(waves, batch_wave_[i] + 1);
+        }
+
+        for (std::size_t w = 0; w < waves; w++) {
+            decode_idx_.clear();
+            decode_sessions_.clear();
+            decode_plays_.clear();
+            decode_caches_.clear();
+            prefill_idx_.clear();
+            prefill_sessions_.clear();
+            prefill_games_.clear();
+            prefill_caches_.clear();
+
+            for (std::size_t i = 0; i < batch.size(); i++) {
+                if (batch_wave_[i] != w) continue;
+                auto& s = sessions_[batch[i].req.play.game_id];
+                s.last_used = batch[i].arrived;
+                play::append_play(s.history, batch[i].req.play);
+                if (!s.cache) {
+                    if (free_caches_.empty()) {
+                        s.cache = std::make_unique<model::kv_cache>(model_.get_config());
+                    } else {
+                        s.cache = std::move(free_caches_.back());
+                        free_caches_.pop_back();
+                    }
+                }
+                if (s.cached + 1 == s.history.size() && s.cache->size() < s.cache->capacity()) {
+                    decode_idx_.push_back(i);
+                    decode_sessions_.push_back(&s);
+                    decode_plays_.push_back(s.history.back());
+                    decode_caches_.push_back(s.cache.get());
+                } else {
+                    const std::size_t n = std::min(s.history.size(), window());
+                    prefill_idx_.push_back(i);
+                    prefill_sessions_.push_back(&s);
+                    prefill_games_.emplace_back(s.history.data() + s.history.size() - n, n);
+                    prefill_caches_.push_back(s.cache.get());
+                }
+            }
+            run_wave();
+        }
+        batches_.fetch_add(1);
+        live_sessions_.store(sessions_.size());
+
+        std::vector<double> done_us;
+        done_us.reserve(batch.size());
+        for (std::size_t i = 0; i < batch.size(); i++) {
+            response_frame resp;
+            resp.request_id = batch[i].req.request_id;
+            const bool ok = batch_ok_[i];
+            resp.code = ok ? status::ok : status::error;
+            if (ok) {
+                resp.win_prob = batch_out_[i].win_prob;
+                std::copy(batch_out_[i].next_event.begin(), batch_out_[i].next_event.end(), resp.next_event);
+            }
+            send_reply(*batch[i].conn, resp);
+            done_us.push_back(std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - batch[i].arrived).count());
+        }
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            latencies_us_.insert(latencies_us_.end(), done_us.begin(), done_us.end());
+        }
+
+        // A finished game's history is no longer needed; its cache goes back to the pool.
+        for (const auto& p : batch) {
+            if (p.req.play.type_code != play::game_end_code) continue;
+            auto it = sessions_.find(p.req.play.game_id);
+            if (it != sessions_.end()) end_session(it);
+        }
+        live_sessions_.store(sessions_.size());
+    }
+
+    void inference_server::end_session(std::unordered_map<std::uint32_t, session>::iterator it) {
+        // Keep at most a batch worth of spare caches; a burst of ended games
+        // should not pin their memory for good.
+        if (it->second.cache && free_caches_.size() < opts_.max_batch) {
+            it->second.cache->clear();
+            free_caches_.push_back(std::move(it->second.cache));
+        }
+        sessions_.erase(it);
+    }
+
+    // Sweeps twice per idle period, so a session lives at most 1.5x session_idle_ms
+    // past its last play.
+    void inference_server::evict_idle_sessions() {
+        const auto now = std::chrono::steady_clock::now();
+        if (now < next_sweep_) return;
+        const auto idle = std::chrono::milliseconds(opts_.session_idle_ms);
+        next_sweep_ = now + std::max<std::chrono::milliseconds>(idle / 2, std::chrono::milliseconds(1));
+        for (auto it = sessions_.begin(); it != sessions_.end();) {
+            auto next = std::next(it);
+            if (now - it->second.last_used > idle) end_session(it);
+            it = next;
+        }
+        live_sessions_.store(sessions_.size());
+    }
+
+    void inference_server::run_wave() {
+        auto scatter = [&](const std::vector<std::size_t>& idx, const std::vector<session*>& sessions,
+                           const std::vector<model::prediction>& out, bool ok) {
+            for (std::size_t k = 0; k < idx.size(); k++) {
+                batch_ok_[idx[k]] = ok;
+                if (!ok) continue;
+                batch_out_[idx[k]] = out[k];
+                sessions[k]->cached = sessions[k]->history.size();
+            }
+        };
+
+        if (!decode_idx_.empty()) {
+            bool ok = true;
+            try {
+                model_.decode(decode_plays_, decode_caches_, ws_, std::span(decode_out_.data(), decode_idx_.size()));
+            } catch (const std::exception& e) {
+                std::cerr << "inference_server: decode failed: " << e.what() << "\n";
+                ok = false;
+            }
+            scatter(decode_idx_, decode_sessions_, decode_out_, ok);
+        }
+        if (!prefill_idx_.empty()) {
+            bool ok = true;
+            try {
+                model_.prefill(prefill_games_, prefill_caches_, ws_, std::span(prefill_out_.data(), prefill_idx_.size()));
+            } catch (const std::exception& e) {
+                std::cerr << "inference_server: prefill failed: " << e.what() << "\n";
+                ok = false;
+            }
+            scatter(prefill_idx_, prefill_sessions_, prefill_out_, ok);
+        }
+    }
+}
@@ -1,5 +1,252 @@
+#include "../include/model.hpp"
+#include "../include/inference_server.hpp"
+#include "../include/trainer.hpp"
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
 
+using hml::model::transformer;
 
-int main() {
+static void usage() {
+    std::cerr << "usage: nhl_transformer <command> [options]\n"
+                 "  init  --out FILE [--seed N]              write a randomly initialised checkpoint\n"
+                 "  serve [--checkpoint FILE] [--socket PATH] [--max-batch N] [--max-wait-us N]\n"
+                 "        [--session-idle-ms N]\n"
+                 "  train [--data DIR [--seasons FIRST-LAST] | --games N] [--steps N] [--batch N] [--window N]\n"
+                 "        [--optimizer sgd|adam|adamw] [--lr X] [--momentum X] [--weight-decay X] [--clip NORM]\n"
+                 "        [--bucket-kb N] [--seed N] [--out FILE]\n"
+                 "        [--procs N | --scaling 1,2,4]                     run N local ranks / compare world sizes\n"
+                 "        [--rank R --world W --address unix:PATH|tcp:HOST[,HOST...]:PORT]   one rank of a larger job\n";
+}
+
+static hml::serving::inference_server* running_server = nullptr;
+
+static void handle_signal(int) {
+    if (running_server) running_server->stop();
+}
+
+static int cmd_init(int argc, char** argv) {
+    std::string out;
+    std::uint64_t seed = 0x5eed;
+    for (int i = 0; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) out = argv[++i];
+        else if (arg == "--seed" && i + 1 < argc) seed = std::stoull(argv[++i]);
+        else { usage(); return 2; }
+    }
+    if (out.empty()) { usage(); return 2; }
+    transformer(hml::model::config{}, seed).save(out);
+    std::cout << "Wrote " << out << "\n";
+    return 0;
+}
+
+static int cmd_serve(int argc, char** argv) {
+    std::string checkpoint;
+    hml::serving::server_options opts;
+    for (int i = 0; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--checkpoint" && i + 1 < argc) checkpoint = argv[++i];
+        else if (arg == "--socket" && i + 1 < argc) opts.socket_path = argv[++i];
+        else if (arg == "--max-batch" && i + 1 < argc) opts.max_batch = std::stoul(argv[++i]);
+        else if (arg == "--max-wait-us" && i + 1 < argc) opts.max_wait_us = std::stoul(argv[++i]);
+        else if (arg == "--session-idle-ms" && i + 1 < argc) opts.session_idle_ms = std::stoul(argv[++i]);
+        else { usage(); return 2; }
+    }
+
+    transformer model = checkpoint.empty() ? transformer(hml::model::config{}) : transformer::load(checkpoint);
+    if (checkpoint.empty()) std::cerr << "No --checkpoint given, serving randomly initialised weights\n";
+
+    hml::serving::inference_server server(std::move(model), opts);
+    running_server = &server;
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+    std::cout << "Listening on " << opts.socket_path << " (max batch " << opts.max_batch
+              << ", max wait " << opts.max_wait_us << "us)\n";
+    server.run();
+    running_server = nullptr;
+
+    auto s = server.stats();
+    std::cout << "Served " << s.count << " requests in " << server.batches() << " batches"
+              << "  p50 " << s.p50_us << "us  p99 " << s.p99_us << "us  max " << s.max_us << "us\n";
+    return 0;
+}
+
+static void write_report(const std::string& path, const hml::train::report& r) {
+    std::ofstream out(path);
+    out << std::setprecision(17) << r.steps << ' ' << r.samples << ' ' << r.seconds << ' ' << r.compute_seconds << ' '
+        << r.comm_seconds << ' ' << r.exposed_seconds << ' ' << r.optimizer_seconds << ' ' << r.bytes_sent << ' ' << r.first_loss << ' ' << r.last_loss << '\n';
+    if (!out) throw std::runtime_error("cannot write " + path);
+}
+
+static hml::train::report read_report(const std::string& path) {
+    hml::train::report r;
+    std::ifstream in(path);
+    in >> r.steps >> r.samples >> r.seconds >> r.compute_seconds >> r.comm_seconds >> r.exposed_seconds >> r.optimizer_seconds >> r.bytes_sent
+       >> r.first_loss >> r.last_loss;
+    if (!in) throw std::runtime_error("no training report from rank 0");
+    return r;
+}
+
+static void print_report(std::size_t world, const hml::train::report& r) {
+    std::cout << std::fixed << std::setprecision(3) << world << " rank(s): " << r.steps << " steps, "
+              << std::setprecision(1) << r.samples_per_second() << " windows/s  compute " << std::setprecision(3)
+              << r.compute_seconds << "s  all-reduce " << r.comm_seconds << "s (exposed " << r.exposed_seconds
+              << "s)  optimizer " << r.optimizer_seconds << "s  loss " << r.first_loss << " -> " << r.last_loss << "\n";
+}
+
+// Runs world copies of this executable as ranks 0..world-1 of one job over a
+// unix socket ring and returns rank 0's report. Each rank gets an equal share
+// of the cores unless HML_NUM_THREADS is already set.
+static hml::train::report launch(std::size_t world, const std::vector<std::string>& args) {
+    const std::string base = "/tmp/nhl_train_" + std::to_string(::getpid()) + "_" + std::to_string(world);
+    const std::string report_path = base + ".report";
+    const std::size_t threads = std::max<std::size_t>(1, std::thread::hardware_concurrency() / world);
+
+    std::vector<pid_t> children;
+    for (std::size_t r = 0; r < world; r++) {
+        std::vector<std::string> child = {"nhl_transformer", "train"};
+        child.insert(child.end(), args.begin(), args.end());
+        child.insert(child.end(), {"--rank", std::to_string(r), "--world", std::to_string(world), "--address", "unix:" + base});
+        if (r == 0) child.insert(child.end(), {"--report", report_path});
+
+        const pid_t pid = ::fork();
+        if (pid < 0) throw std::runtime_error("fork failed");
+        if (pid == 0) {
+            if (!std::getenv("HML_NUM_THREADS")) ::setenv("HML_NUM_THREADS", std::to_string(threads).c_str(), 1);
+            std::vector<char*> cargv;
+            for (auto& a : child) cargv.push_back(a.data());
+            cargv.push_back(nullptr);
+            ::execv("/proc/self/exe", cargv.data());
+            ::_exit(127);
+        }
+        children.push_back(pid);
+    }
+
+    std::string failed;
+    for (std::size_t r = 0; r < world; r++) {
+        int status = 0;
+        ::waitpid(children[r], &status, 0);
+        if (WIFSIGNALED(status)) failed += " rank " + std::to_string(r) + " (signal " + std::to_string(WTERMSIG(status)) + ")";
+        else if (WEXITSTATUS(status) != 0) failed += " rank " + std::to_string(r) + " (exit " + std::to_string(WEXITSTATUS(status)) + ")";
+    }
+    if (!failed.empty()) throw std::runtime_error("training failed:" + failed);
+    auto rep = read_report(report_path);
+    std::remove(report_path.c_str());
+    return rep;
+}
+
+// Rank counts: 0 would mean an empty ring (and a division by zero in launch).
+static std::size_t parse_ranks(std::string_view flag, const std::string& value) {
+    const std::size_t n = std::stoul(value);
+    if (n == 0) throw std::invalid_argument(std::string(flag) + " must be at least 1");
+    return n;
+}
+
+static int cmd_train(int argc, char** argv) {
+    hml::train::options opts;
+    std::string out, address, report_path;
+    std::size_t rank = 0, world = 0, procs = 1;
+    std::vector<std::size_t> scaling;
+    std::vector<std::string> forward;   // passed on to launched ranks
+    for (int i = 0; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (i + 1 >= argc) { usage(); return 2; }
+        const std::string value = argv[++i];
+        if (arg == "--procs") procs = parse_ranks(arg, value);
+        else if (arg == "--scaling") {
+            for (std::size_t pos = 0; pos < value.size();) {
+                const auto comma = std::min(value.find(',', pos), value.size());
+                scaling.push_back(parse_ranks(arg, value.substr(pos, comma - pos)));
+                pos = comma + 1;
+            }
+        }
+        else if (arg == "--rank") rank = std::stoul(value);
+        else if (arg == "--world") world = parse_ranks(arg, value);
+        else if (arg == "--address") address = value;
+        else if (arg == "--report") report_path = value;
+        else {
+            if (arg == "--data") opts.data_dir = value;
+            else if (arg == "--seasons") {
+                const auto dash = value.find('-');
+                opts.first_season = std::stoi(value.substr(0, dash));
+                opts.last_season = dash == std::string::npos ? opts.first_season : std::stoi(value.substr(dash + 1));
+            }
+            else if (arg == "--games") opts.synthetic_games = std::stoul(value);
+            else if (arg == "--steps") opts.steps = std::stoul(value);
+            else if (arg == "--batch") opts.batch = std::stoul(value);
+            else if (arg == "--window") opts.window = std::stoul(value);
+            else if (arg == "--optimizer") opts.optim.type = hml::optim::parse_method(value);
+            else if (arg == "--lr") opts.optim.lr = std::stof(value);
+            else if (arg == "--momentum") opts.optim.momentum = std::stof(value);
+            else if (arg == "--weight-decay") opts.optim.weight_decay = std::stof(value);
+            else if (arg == "--clip") opts.optim.clip_norm = std::stof(value);
+            else if (arg == "--bucket-kb") opts.bucket_kb = std::stoul(value);
+            else if (arg == "--seed") opts.seed = std::stoull(value);
+            else if (arg == "--out") out = value;
+            else { usage(); return 2; }
+            forward.insert(forward.end(), {std::string(arg), value});
+        }
+    }
+
+    if (world == 0 && !scaling.empty()) {
+        // Weak scaling: every rank keeps the same batch, so ideal throughput grows with world size.
+        std::vector<std::pair<std::size_t, hml::train::report>> runs;
+        for (std::size_t w : scaling) {
+            runs.emplace_back(w, launch(w, forward));
+            print_report(w, runs.back().second);
+        }
+        const double base = runs.front().second.samples_per_second() / static_cast<double>(runs.front().first);
+        std::cout << "\nranks  windows/s  efficiency\n";
+        for (const auto& [w, r] : runs) {
+            std::cout << std::setw(5) << w << std::setw(11) << std::setprecision(1) << r.samples_per_second()
+                      << std::setw(11) << std::setprecision(2) << r.samples_per_second() / (base * static_cast<double>(w)) << "\n";
+        }
+        return 0;
+    }
+    if (world == 0 && procs > 1) {
+        print_report(procs, launch(procs, forward));
+        return 0;
+    }
+
+    if (world == 0) world = 1;
+    auto games = hml::train::load_shard(opts, rank, world);
+    hml::dist::ring ring(rank, world, address);
+    transformer model(opts.cfg, opts.seed);
+    auto rep = hml::train::run(model, games, opts, ring);
+    if (rank == 0) {
+        if (report_path.empty()) print_report(world, rep);
+        else write_report(report_path, rep);
+        if (!out.empty()) {
+            model.save(out);
+            std::cout << "Wrote " << out << "\n";
+        }
+    }
+    return 0;
+}
 
+int main(int argc, char** argv) {
+    if (argc < 2) { usage(); return 2; }
+    const std::string_view cmd = argv[1];
+    try {
+        if (cmd == "init") return cmd_init(argc - 2, argv + 2);
+        if (cmd == "serve") return cmd_serve(argc - 2, argv + 2);
+        if (cmd == "train") return cmd_train(argc - 2, argv + 2);
+    } catch (const std::exception& e) {
+        std::cerr << "nhl_transformer: " << e.what() << "\n";
+        return 1;
+    }
+    usage();
+    return 2;
 }
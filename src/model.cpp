@@ -0,0 +1,639 @@
+#include "../include/model.hpp"
+#include "../include/nn.hpp"
+#include "../include/thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+namespace hml::model {
+    workspace::workspace(const config& cfg, std::size_t max_games, std::size_t max_tokens)
+        : max_games_(max_games), max_tokens_(max_tokens),
+          feats_{max_tokens, play::num_features},
+          x_{max_tokens, cfg.d_model},
+          h_{max_tokens, cfg.d_model},
+          qkv_{max_tokens, 3 * cfg.d_model},
+          att_{max_tokens, cfg.d_model},
+          ff_{max_tokens, cfg.d_ff},
+          last_{max_games, cfg.d_model},
+          logits_{max_games, play::vocab_size} {
+        offsets_.reserve(max_games + 1);
+        token_game_.reserve(max_tokens);
+    }
+
+    std::size_t workspace::max_games() const noexcept { return max_games_; }
+    std::size_t workspace::max_tokens() const noexcept { return max_tokens_; }
+
+    train_workspace::train_workspace(const config& cfg, std::size_t max_games, std::size_t max_window)
+        : max_games_(max_games), max_window_(std::min(max_window, cfg.max_seq)) {
+        const std::size_t tokens = max_games_ * max_window_;
+        const std::size_t d = cfg.d_model;
+        feats_ = tensor::tensor{tokens, play::num_features};
+        layers_.resize(cfg.n_layers);
+        for (auto& l : layers_) {
+            l.x_in = tensor::tensor{tokens, d};
+            l.ln1 = tensor::tensor{tokens, d};
+            l.qkv = tensor::tensor{tokens, 3 * d};
+            l.probs = tensor::tensor{tokens, cfg.n_heads, max_window_};
+            l.att = tensor::tensor{tokens, d};
+            l.x_mid = tensor::tensor{tokens, d};
+            l.ln2 = tensor::tensor{tokens, d};
+            l.ff_pre = tensor::tensor{tokens, cfg.d_ff};
+            l.ff_act = tensor::tensor{tokens, cfg.d_ff};
+        }
+        x_ = tensor::tensor{tokens, d};
+        ln_f_ = tensor::tensor{tokens, d};
+        logits_ = tensor::tensor{tokens, play::vocab_size};
+        win_ = tensor::tensor{tokens};
+        dx_ = tensor::tensor{tokens, d};
+        dh_ = tensor::tensor{tokens, d};
+        dh2_ = tensor::tensor{tokens, d};
+        datt_ = tensor::tensor{tokens, d};
+        dqkv_ = tensor::tensor{tokens, 3 * d};
+        dff_ = tensor::tensor{tokens, cfg.d_ff};
+        ln_scratch_ = tensor::tensor{2 * tokens};
+        offsets_.reserve(max_games + 1);
+        types_.reserve(tokens);
+    }
+
+    std::size_t train_workspace::max_games() const noexcept { return max_games_; }
+    std::size_t train_workspace::max_window() const noexcept { return max_window_; }
+
+    // What is wrong with cfg, or nullptr if a model can be built from it.
+    static const char* config_error(const config& cfg) noexcept {
+        if (cfg.d_model == 0 || cfg.n_heads == 0 || cfg.d_model % cfg.n_heads != 0) return "d_model must be a positive multiple of n_heads";
+        if (cfg.d_ff == 0) return "d_ff must be positive";
+        if (cfg.max_seq == 0) return "max_seq must be positive";
+        return nullptr;
+    }
+
+    transformer::transformer(const config& cfg, std::uint64_t seed) : cfg_(cfg) {
+        if (const char* err = config_error(cfg_)) throw std::invalid_argument(std::string("transformer: ") + err);
+        allocate();
+
+        std::mt19937_64 rng(seed);
+        std::normal_distribution<float> normal(0.0f, 0.02f);
+        visit(*this, [&](const std::string& name, tensor::tensor& t) {
+            float* p = t.data();
+            const bool gain = name.ends_with("_g");
+            const bool bias = name.ends_with(".b") || name.ends_with("_b");
+            for (std::size_t i = 0; i < t.size(); i++) {
+                p[i] = gain ? 1.0f : bias ? 0.0f : normal(rng);
+            }
+        });
+    }
+
+    void transformer::allocate() {
+        const std::size_t d = cfg_.d_model;
+        embed_ = tensor::tensor{play::vocab_size, d};
+        pos_ = tensor::tensor{cfg_.max_seq, d};
+        w_in_ = tensor::tensor{play::num_features, d};
+        b_in_ = tensor::tensor{d};
+        layers_.resize(cfg_.n_layers);
+        for (auto& l : layers_) {
+            l.ln1_g = tensor::tensor{d};
+            l.ln1_b = tensor::tensor{d};
+            l.w_qkv = tensor::tensor{d, 3 * d};
+            l.b_qkv = tensor::tensor{3 * d};
+            l.w_o = tensor::tensor{d, d};
+            l.b_o = tensor::tensor{d};
+            l.ln2_g = tensor::tensor{d};
+            l.ln2_b = tensor::tensor{d};
+            l.w_ff1 = tensor::tensor{d, cfg_.d_ff};
+            l.b_ff1 = tensor::tensor{cfg_.d_ff};
+            l.w_ff2 = tensor::tensor{cfg_.d_ff, d};
+            l.b_ff2 = tensor::tensor{d};
+        }
+        ln_f_g_ = tensor::tensor{d};
+        ln_f_b_ = tensor::tensor{d};
+        w_win_ = tensor::tensor{d, 1};
+        b_win_ = tensor::tensor{1};
+        w_next_ = tensor::tensor{d, play::vocab_size};
+        b_next_ = tensor::tensor{play::vocab_size};
+    }
+
+    // Calls fn(name, tensor) for every parameter in checkpoint order.
+    template <class Self, class Fn>
+    void transformer::visit(Self& self, Fn&& fn) {
+        fn("embed", self.embed_);
+        fn("pos", self.pos_);
+        fn("in.w", self.w_in_);
+        fn("in.b", self.b_in_);
+        for (std::size_t i = 0; i < self.layers_.size(); i++) {
+            auto& l = self.layers_[i];
+            const std::string p = "layers." + std::to_string(i) + ".";
+            fn(p + "ln1_g", l.ln1_g);
+            fn(p + "ln1_b", l.ln1_b);
+            fn(p + "qkv.w", l.w_qkv);
+            fn(p + "qkv.b", l.b_qkv);
+            fn(p + "o.w", l.w_o);
+            fn(p + "o.b", l.b_o);
+            fn(p + "ln2_g", l.ln2_g);
+            fn(p + "ln2_b", l.ln2_b);
+            fn(p + "ff1.w", l.w_ff1);
+            fn(p + "ff1.b", l.b_ff1);
+            fn(p + "ff2.w", l.w_ff2);
+            fn(p + "ff2.b", l.b_ff2);
+        }
+        fn("ln_f_g", self.ln_f_g_);
+        fn("ln_f_b", self.ln_f_b_);
+        fn("win.w", self.w_win_);
+        fn("win.b", self.b_win_);
+        fn("next.w", self.w_next_);
+        fn("next.b", self.b_next_);
+    }
+
+    void transformer::save(const std::string& path) const {
+        tensor::tensor cfg{5};
+        float* c = cfg.data();
+        c[0] = static_cast<float>(cfg_.d_model);
+        c[1] = static_cast<float>(cfg_.n_heads);
+        c[2] = static_cast<float>(cfg_.n_layers);
+        c[3] = static_cast<float>(cfg_.d_ff);
+        c[4] = static_cast<float>(cfg_.max_seq);
+        std::vector<checkpoint::entry> entries;
+        visit(*this, [&](const std::string& name, const tensor::tensor& t) { entries.emplace_back(name, &t); });
+        entries.emplace_back("config", &cfg);
+        checkpoint::save(path, entries);
+    }
+
+    transformer transformer::load(const std::string& path) {
+        auto tensors = checkpoint::load(path);
+        auto cfg_it = tensors.find("config");
+        if (cfg_it == tensors.end() || cfg_it->second.size() != 5)
+            throw std::runtime_error("transformer: checkpoint has no model config: " + path);
+        const float* c = cfg_it->second.data();
+        // Sizes are stored as floats; anything that is not a whole number in
+        // range would make the casts below undefined.
+        for (std::size_t i = 0; i < 5; i++) {
+            if (!(c[i] >= 0.0f && c[i] <= 16777216.0f) || c[i] != std::floor(c[i]))
+                throw std::runtime_error("transformer: bad model config in " + path);
+        }
+
+        transformer res;
+        res.cfg_ = config{static_cast<std::size_t>(c[0]), static_cast<std::size_t>(c[1]),
+                          static_cast<std::size_t>(c[2]), static_cast<std::size_t>(c[3]),
+                          static_cast<std::size_t>(c[4])};
+        if (const char* err = config_error(res.cfg_)) throw std::runtime_error("transformer: bad model config in " + path + ": " + err);
+        res.allocate();
+        // Move the mapped tensors in so the weights stay zero-copy.
+        visit(res, [&](const std::string& name, tensor::tensor& t) {
+            auto it = tensors.find(name);
+            if (it == tensors.end()) throw std::runtime_error("transformer: checkpoint is missing " + name);
+            if (it->second.get_shape() != t.get_shape()) throw std::runtime_error("transformer: shape mismatch for " + name);
+            t = std::move(it->second);
+        });
+        return res;
+    }
+
+    const config& transformer::get_config() const noexcept { return cfg_; }
+
+    kv_cache::kv_cache(const config& cfg)
+        : kv_{cfg.n_layers == 0 ? 1 : cfg.n_layers, 2, cfg.max_seq, cfg.d_model}, max_seq_(cfg.max_seq), d_model_(cfg.d_model) {}
+
+    std::size_t kv_cache::size() const noexcept { return len_; }
+    std::size_t kv_cache::capacity() const noexcept { return max_seq_; }
+    void kv_cache::clear() noexcept { len_ = 0; }
+
+    float* kv_cache::keys(std::size_t layer) noexcept { return kv_.data() + (layer * 2) * max_seq_ * d_model_; }
+    float* kv_cache::values(std::size_t layer) noexcept { return kv_.data() + (layer * 2 + 1) * max_seq_ * d_model_; }
+
+    void transformer::forward(std::span<const std::span<const play::play_event>> games, workspace& ws,
+                              std::span<prediction> out) const {
+        run(games, {}, ws, out);
+    }
+
+    void transformer::prefill(std::span<const std::span<const play::play_event>> games, std::span<kv_cache* const> caches,
+                              workspace& ws, std::span<prediction> out) const {
+        if (caches.size() != games.size()) throw std::invalid_argument("transformer: need one cache per game");
+        for (const kv_cache* c : caches) {
+            if (!fits(*c)) throw std::invalid_argument("transformer: kv cache was built for a different config");
+        }
+        run(games, caches, ws, out);
+    }
+
+    void transformer::run(std::span<const std::span<const play::play_event>> games, std::span<kv_cache* const> caches,
+                          workspace& ws, std::span<prediction> out) const {
+        if (out.size() != games.size()) throw std::invalid_argument("transformer: need one prediction per game");
+        if (games.size() > ws.max_games_) throw std::invalid_argument("transformer: batch exceeds workspace");
+        if (games.empty()) return;
+
+        const std::size_t d = cfg_.d_model;
+        const std::size_t heads = cfg_.n_heads;
+        const std::size_t hd = d / heads;
+
+        // Pack every game's (windowed) plays back to back.
+        ws.offsets_.assign(1, 0);
+        ws.token_game_.clear();
+        std::size_t longest = 0;
+        for (std::size_t g = 0; g < games.size(); g++) {
+            const std::size_t len = std::min(games[g].size(), cfg_.max_seq);
+            if (len == 0) throw std::invalid_argument("transformer: game has no plays");
+            if (ws.offsets_.back() + len > ws.max_tokens_) throw std::invalid_argument("transformer: batch exceeds workspace");
+            ws.offsets_.push_back(ws.offsets_.back() + len);
+            ws.token_game_.insert(ws.token_game_.end(), len, g);
+            longest = std::max(longest, len);
+        }
+        const std::size_t tokens = ws.offsets_.back();
+        const std::size_t* offsets = ws.offsets_.data();
+        const std::size_t* token_game = ws.token_game_.data();
+
+        float* feats = ws.feats_.data();
+        float* x = ws.x_.data();
+        float* h = ws.h_.data();
+        float* qkv = ws.qkv_.data();
+        float* att = ws.att_.data();
+
+        parallel::parallel_for(0, tokens, parallel::grain_for(d), [&](std::size_t lo, std::size_t hi) {
+            for (std::size_t r = lo; r < hi; r++) {
+                const std::size_t g = token_game[r];
+                const std::size_t t = r - offsets[g];
+                const auto& p = games[g][games[g].size() - (offsets[g + 1] - offsets[g]) + t];
+                play::encode_features(p, feats + r * play::num_features);
+            }
+        });
+        nn::linear(feats, w_in_.data(), b_in_.data(), x, tokens, play::num_features, d);
+        parallel::parallel_for(0, tokens, parallel::grain_for(d), [&](std::size_t lo, std::size_t hi) {
+            for (std::size_t r = lo; r < hi; r++) {
+                const std::size_t g = token_game[r];
+                const std::size_t t = r - offsets[g];
+                const auto& p = games[g][games[g].size() - (offsets[g + 1] - offsets[g]) + t];
+                const float* e = embed_.data() + play::event_index(p.type_code) * d;
+                const float* pe = pos_.data() + t * d;
+                float* xr = x + r * d;
+                for (std::size_t j = 0; j < d; j++) xr[j] += e[j] + pe[j];
+            }
+        });
+
+        for (std::size_t li = 0; li < layers_.size(); li++) {
+            const auto& l = layers_[li];
+            nn::layer_norm(x, l.ln1_g.data(), l.ln1_b.data(), h, tokens, d);
+            nn::linear(h, l.w_qkv.data(), l.b_qkv.data(), qkv, tokens, d, 3 * d);
+
+            // Keep each game's keys and values so decode() can carry on from here.
+            for (std::size_t g = 0; g < caches.size(); g++) {
+                float* k = caches[g]->keys(li);
+                float* v = caches[g]->values(li);
+                for (std::size_t r = offsets[g]; r < offsets[g + 1]; r++) {
+                    const std::size_t t = r - offsets[g];
+                    std::copy_n(qkv + r * 3 * d + d, d, k + t * d);
+                    std::copy_n(qkv + r * 3 * d + 2 * d, d, v + t * d);
+                }
+            }
+
+            parallel::parallel_for(0, tokens * heads, parallel::grain_for(longest * hd), [&](std::size_t lo, std::size_t hi) {
+                thread_local std::vector<float> scratch;
+                if (scratch.size() < cfg_.max_seq) scratch.resize(cfg_.max_seq);
+                for (std::size_t idx = lo; idx < hi; idx++) {
+                    const std::size_t r = idx / heads;
+                    const std::size_t head = idx % heads;
+                    const std::size_t base = offsets[token_game[r]];
+                    const float* q = qkv + r * 3 * d + head * hd;
+                    const float* k = qkv + base * 3 * d + d + head * hd;
+                    const float* v = qkv + base * 3 * d + 2 * d + head * hd;
+                    nn::attend(q, k, v, 3 * d, r - base + 1, hd, att + r * d + head * hd, scratch.data());
+                }
+            });
+
+            nn::linear(att, l.w_o.data(), l.b_o.data(), h, tokens, d, d);
+            nn::add(x, h, tokens * d);
+            mlp(l, ws, tokens);
+        }
+        for (std::size_t g = 0; g < caches.size(); g++) caches[g]->len_ = offsets[g + 1] - offsets[g];
+
+        float* last = ws.last_.data();
+        for (std::size_t g = 0; g < games.size(); g++) {
+            nn::layer_norm(x + (offsets[g + 1] - 1) * d, ln_f_g_.data(), ln_f_b_.data(), last + g * d, 1, d);
+        }
+        predict(ws, out);
+    }
+
+    void transformer::decode(std::span<const play::play_event> plays, std::span<kv_cache* const> caches,
+                             workspace& ws, std::span<prediction> out) const {
+        const std::size_t n = plays.size();
+        if (caches.size() != n || out.size() != n) throw std::invalid_argument("transformer: need one cache and prediction per play");
+        if (n > ws.max_games_ || n > ws.max_tokens_) throw std::invalid_argument("transformer: batch exceeds workspace");
+        for (std::size_t b = 0; b < n; b++) {
+            if (caches[b]->size() >= cfg_.max_seq) throw std::invalid_argument("transformer: kv cache is full");
+            if (!fits(*caches[b]))
+                throw std::invalid_argument("transformer: kv cache was built for a different config");
+            for (std::size_t c = 0; c < b; c++) {
+                if (caches[c] == caches[b]) throw std::invalid_argument("transformer: a cache can take one play per decode");
+            }
+        }
+        if (n == 0) return;
+
+        const std::size_t d = cfg_.d_model;
+        const std::size_t heads = cfg_.n_heads;
+        const std::size_t hd = d / heads;
+        float* feats = ws.feats_.data();
+        float* x = ws.x_.data();
+        float* h = ws.h_.data();
+        float* qkv = ws.qkv_.data();
+        float* att = ws.att_.data();
+
+        for (std::size_t b = 0; b < n; b++) play::encode_features(plays[b], feats + b * play::num_features);
+        nn::linear(feats, w_in_.data(), b_in_.data(), x, n, play::num_features, d);
+        for (std::size_t b = 0; b < n; b++) {
+            const float* e = embed_.data() + play::event_index(plays[b].type_code) * d;
+            const float* pe = pos_.data() + caches[b]->size() * d;
+            float* xb = x + b * d;
+            for (std::size_t j = 0; j < d; j++) xb[j] += e[j] + pe[j];
+        }
+
+        std::size_t longest = 0;
+        for (std::size_t b = 0; b < n; b++) longest = std::max(longest, caches[b]->size() + 1);
+
+        for (std::size_t li = 0; li < layers_.size(); li++) {
+            const auto& l = layers_[li];
+            nn::layer_norm(x, l.ln1_g.data(), l.ln1_b.data(), h, n, d);
+            nn::linear(h, l.w_qkv.data(), l.b_qkv.data(), qkv, n, d, 3 * d);
+            for (std::size_t b = 0; b < n; b++) {
+                const std::size_t t = caches[b]->size();
+                std::copy_n(qkv + b * 3 * d + d, d, caches[b]->keys(li) + t * d);
+                std::copy_n(qkv + b * 3 * d + 2 * d, d, caches[b]->values(li) + t * d);
+            }
+
+            // One query per game against everything cached so far.
+            parallel::parallel_for(0, n * heads, parallel::grain_for(longest * hd), [&](std::size_t lo, std::size_t hi) {
+                thread_local std::vector<float> scratch;
+                if (scratch.size() < cfg_.max_seq) scratch.resize(cfg_.max_seq);
+                for (std::size_t idx = lo; idx < hi; idx++) {
+                    const std::size_t b = idx / heads;
+                    const std::size_t head = idx % heads;
+                    const float* q = qkv + b * 3 * d + head * hd;
+                    const float* k = caches[b]->keys(li) + head * hd;
+                    const float* v = caches[b]->values(li) + head * hd;
+                    nn::attend(q, k, v, d, caches[b]->size() + 1, hd, att + b * d + head * hd, scratch.data());
+                }
+            });
+
+            nn::linear(att, l.w_o.data(), l.b_o.data(), h, n, d, d);
+            nn::add(x, h, n * d);
+            mlp(l, ws, n);
+        }
+        for (std::size_t b = 0; b < n; b++) caches[b]->len_++;
+
+        nn::layer_norm(x, ln_f_g_.data(), ln_f_b_.data(), ws.last_.data(), n, d);
+        predict(ws, out);
+    }
+
+    bool transformer::fits(const kv_cache& c) const noexcept {
+        return c.max_seq_ == cfg_.max_seq && c.d_model_ == cfg_.d_model && c.kv_.get_shape()[0] >= layers_.size();
+    }
+
+    void transformer::mlp(const layer& l, workspace& ws, std::size_t rows) const {
+        const std::size_t d = cfg_.d_model;
+        float* x = ws.x_.data();
+        float* h = ws.h_.data();
+        float* ff = ws.ff_.data();
+        nn::layer_norm(x, l.ln2_g.data(), l.ln2_b.data(), h, rows, d);
+        nn::linear(h, l.w_ff1.data(), l.b_ff1.data(), ff, rows, d, cfg_.d_ff);
+        nn::gelu(ff, rows * cfg_.d_ff);
+        nn::linear(ff, l.w_ff2.data(), l.b_ff2.data(), h, rows, cfg_.d_ff, d);
+        nn::add(x, h, rows * d);
+    }
+
+    // Win and next-event heads over the final-normed rows in ws.last_.
+    void transformer::predict(workspace& ws, std::span<prediction> out) const {
+        const std::size_t d = cfg_.d_model;
+        const float* last = ws.last_.data();
+        float* logits = ws.logits_.data();
+        nn::linear(last, w_next_.data(), b_next_.data(), logits, out.size(), d, play::vocab_size);
+        for (std::size_t g = 0; g < out.size(); g++) {
+            float z = b_win_.data()[0];
+            for (std::size_t j = 0; j < d; j++) z += last[g * d + j] * w_win_.data()[j];
+            out[g].win_prob = 1.0f / (1.0f + std::exp(-z));
+            float* row = logits + g * play::vocab_size;
+            nn::softmax(row, play::vocab_size);
+            std::copy(row, row + play::vocab_size, out[g].next_event.begin());
+        }
+    }
+
+    bool transformer::is_flat() const noexcept {
+        return flat_ && !flat_->empty() && embed_.data() == flat_->data();
+    }
+
+    void transformer::flatten() {
+        if (is_flat()) return;
+        std::size_t total = 0;
+        visit(*this, [&](const std::string&, const tensor::tensor& t) { total += t.size(); });
+        auto flat = std::make_shared<std::vector<float>>(total);
+        std::size_t offset = 0;
+        visit(*this, [&](const std::string&, tensor::tensor& t) {
+            float* dst = flat->data() + offset;
+            std::copy(t.data(), t.data() + t.size(), dst);
+            offset += t.size();
+            t = tensor::tensor::from_external(t.get_shape(), dst, flat);
+        });
+        flat_ = std::move(flat);
+    }
+
+    std::span<float> transformer::parameters() noexcept {
+        return is_flat() ? std::span<float>(*flat_) : std::span<float>();
+    }
+
+    std::span<const float> transformer::parameters() const noexcept {
+        return is_flat() ? std::span<const float>(*flat_) : std::span<const float>();
+    }
+
+    std::size_t transformer::offset_of(const tensor::tensor& t) const noexcept {
+        return static_cast<std::size_t>(t.data() - flat_->data());
+    }
+
+    transformer transformer::zeros_like() const {
+        transformer res;
+        res.cfg_ = cfg_;
+        res.allocate();
+        res.flatten();
+        return res;
+    }
+
+    float transformer::train_batch(std::span<const sample> batch, train_workspace& ws, transformer& grads,
+                                   const ready_fn& on_ready) const {
+        if (batch.size() > ws.max_games_) throw std::invalid_argument("transformer: batch exceeds train workspace");
+        if (ws.layers_.size() != layers_.size()) throw std::invalid_argument("transformer: train workspace was built for a different config");
+        const config& gc = grads.cfg_;
+        if (!grads.is_flat() || gc.d_model != cfg_.d_model || gc.n_heads != cfg_.n_heads || gc.n_layers != cfg_.n_layers
+            || gc.d_ff != cfg_.d_ff || gc.max_seq != cfg_.max_seq)
+            throw std::invalid_argument("transformer: gradients must come from zeros_like()");
+        if (batch.empty()) return 0.0f;
+
+        const std::size_t d = cfg_.d_model;
+        const std::size_t heads = cfg_.n_heads;
+        const std::size_t hd = d / heads;
+        const std::size_t dff = cfg_.d_ff;
+        const std::size_t window = ws.max_window_;
+
+        ws.offsets_.assign(1, 0);
+        ws.types_.clear();
+        for (const auto& s : batch) {
+            if (s.plays.empty() || s.plays.size() > window) throw std::invalid_argument("transformer: sample must hold 1..max_window plays");
+            ws.offsets_.push_back(ws.offsets_.back() + s.plays.size());
+            for (const auto& p : s.plays) ws.types_.push_back(play::event_index(p.type_code));
+        }
+        const std::size_t tokens = ws.offsets_.back();
+        const std::size_t games = batch.size();
+        const std::size_t* offsets = ws.offsets_.data();
+
+        // Forward, keeping what backward needs.
+        float* feats = ws.feats_.data();
+        float* x = ws.x_.data();
+        for (std::size_t g = 0; g < games; g++) {
+            for (std::size_t t = 0; t < batch[g].plays.size(); t++) {
+                play::encode_features(batch[g].plays[t], feats + (offsets[g] + t) * play::num_features);
+            }
+        }
+        nn::linear(feats, w_in_.data(), b_in_.data(), x, tokens, play::num_features, d);
+        for (std::size_t g = 0; g < games; g++) {
+            for (std::size_t r = offsets[g]; r < offsets[g + 1]; r++) {
+                const float* e = embed_.data() + ws.types_[r] * d;
+                const float* pe = pos_.data() + (r - offsets[g]) * d;
+                for (std::size_t j = 0; j < d; j++) x[r * d + j] += e[j] + pe[j];
+            }
+        }
+
+        for (std::size_t li = 0; li < layers_.size(); li++) {
+            const auto& l = layers_[li];
+            auto& a = ws.layers_[li];
+            float* qkv = a.qkv.data();
+            float* att = a.att.data();
+            float* probs = a.probs.data();
+            std::copy_n(x, tokens * d, a.x_in.data());
+            nn::layer_norm(x, l.ln1_g.data(), l.ln1_b.data(), a.ln1.data(), tokens, d);
+            nn::linear(a.ln1.data(), l.w_qkv.data(), l.b_qkv.data(), qkv, tokens, d, 3 * d);
+            parallel::parallel_for(0, tokens * heads, parallel::grain_for(window * hd), [&](std::size_t lo, std::size_t hi) {
+                for (std::size_t idx = lo; idx < hi; idx++) {
+                    const std::size_t r = idx / heads;
+                    const std::size_t head = idx % heads;
+                    const std::size_t base = offsets[std::upper_bound(offsets, offsets + games + 1, r) - offsets - 1];
+                    const float* q = qkv + r * 3 * d + head * hd;
+                    const float* k = qkv + base * 3 * d + d + head * hd;
+                    const float* v = qkv + base * 3 * d + 2 * d + head * hd;
+                    nn::attend(q, k, v, 3 * d, r - base + 1, hd, att + r * d + head * hd, probs + idx * window);
+                }
+            });
+            nn::linear(att, l.w_o.data(), l.b_o.data(), ws.dh_.data(), tokens, d, d);
+            nn::add(x, ws.dh_.data(), tokens * d);
+            std::copy_n(x, tokens * d, a.x_mid.data());
+            nn::layer_norm(x, l.ln2_g.data(), l.ln2_b.data(), a.ln2.data(), tokens, d);
+            nn::linear(a.ln2.data(), l.w_ff1.data(), l.b_ff1.data(), a.ff_pre.data(), tokens, d, dff);
+            std::copy_n(a.ff_pre.data(), tokens * dff, a.ff_act.data());
+            nn::gelu(a.ff_act.data(), tokens * dff);
+            nn::linear(a.ff_act.data(), l.w_ff2.data(), l.b_ff2.data(), ws.dh_.data(), tokens, dff, d);
+            nn::add(x, ws.dh_.data(), tokens * d);
+        }
+
+        float* ln_f = ws.ln_f_.data();
+        float* logits = ws.logits_.data();
+        float* win = ws.win_.data();
+        nn::layer_norm(x, ln_f_g_.data(), ln_f_b_.data(), ln_f, tokens, d);
+        nn::linear(ln_f, w_next_.data(), b_next_.data(), logits, tokens, d, play::vocab_size);
+        nn::linear(ln_f, w_win_.data(), b_win_.data(), win, tokens, d, 1);
+
+        // Losses, turning logits_ and win_ into their gradients in place.
+        const std::size_t next_terms = tokens - games;
+        double win_loss = 0.0;
+        double next_loss = 0.0;
+        for (std::size_t g = 0; g < games; g++) {
+            const float y = batch[g].home_win;
+            for (std::size_t r = offsets[g]; r < offsets[g + 1]; r++) {
+                const float z = win[r];
+                win_loss += std::max(z, 0.0f) - z * y + std::log1p(std::exp(-std::fabs(z)));
+                win[r] = (1.0f / (1.0f + std::exp(-z)) - y) / static_cast<float>(tokens);
+
+                float* row = logits + r * play::vocab_size;
+                if (r + 1 == offsets[g + 1]) {
+                    std::fill_n(row, play::vocab_size, 0.0f);
+                    continue;
+                }
+                nn::softmax(row, play::vocab_size);
+                const std::size_t target = ws.types_[r + 1];
+                next_loss -= std::log(std::max(row[target], 1e-30f));
+                row[target] -= 1.0f;
+                for (std::size_t j = 0; j < play::vocab_size; j++) row[j] /= static_cast<float>(next_terms);
+            }
+        }
+        const float loss = static_cast<float>(win_loss / static_cast<double>(tokens)
+                                            + (next_terms ? next_loss / static_cast<double>(next_terms) : 0.0));
+
+        auto report = [&](const tensor::tensor& first, const tensor::tensor& last) {
+            if (on_ready) on_ready(grads.offset_of(first), grads.offset_of(last) + last.size());
+        };
+
+        // Heads and final norm.
+        float* dx = ws.dx_.data();
+        float* dh = ws.dh_.data();
+        float* dh2 = ws.dh2_.data();
+        float* scratch = ws.ln_scratch_.data();
+        nn::linear_backward_params(ln_f, logits, grads.w_next_.data(), grads.b_next_.data(), tokens, d, play::vocab_size);
+        nn::linear_backward_params(ln_f, win, grads.w_win_.data(), grads.b_win_.data(), tokens, d, 1);
+        nn::linear_backward_input(logits, w_next_.data(), dh, tokens, d, play::vocab_size);
+        for (std::size_t r = 0; r < tokens; r++) {
+            for (std::size_t j = 0; j < d; j++) dh[r * d + j] += win[r] * w_win_.data()[j];
+        }
+        nn::layer_norm_backward(x, ln_f_g_.data(), dh, dx, grads.ln_f_g_.data(), grads.ln_f_b_.data(), tokens, d, scratch);
+        report(grads.ln_f_g_, grads.b_next_);
+
+        for (std::size_t li = layers_.size(); li-- > 0;) {
+            const auto& l = layers_[li];
+            auto& gl = grads.layers_[li];
+            auto& a = ws.layers_[li];
+            float* dff_buf = ws.dff_.data();
+            float* datt = ws.datt_.data();
+            float* dqkv = ws.dqkv_.data();
+
+            // x_out = x_mid + ff2(gelu(ff1(ln2(x_mid))))
+            nn::linear_backward_params(a.ff_act.data(), dx, gl.w_ff2.data(), gl.b_ff2.data(), tokens, dff, d);
+            nn::linear_backward_input(dx, l.w_ff2.data(), dff_buf, tokens, dff, d);
+            nn::gelu_backward(a.ff_pre.data(), dff_buf, tokens * dff);
+            nn::linear_backward_params(a.ln2.data(), dff_buf, gl.w_ff1.data(), gl.b_ff1.data(), tokens, d, dff);
+            nn::linear_backward_input(dff_buf, l.w_ff1.data(), dh, tokens, d, dff);
+            nn::layer_norm_backward(a.x_mid.data(), l.ln2_g.data(), dh, dh2, gl.ln2_g.data(), gl.ln2_b.data(), tokens, d, scratch);
+            nn::add(dx, dh2, tokens * d);
+
+            // x_mid = x_in + o(attend(qkv(ln1(x_in))))
+            nn::linear_backward_params(a.att.data(), dx, gl.w_o.data(), gl.b_o.data(), tokens, d, d);
+            nn::linear_backward_input(dx, l.w_o.data(), datt, tokens, d, d);
+            const float* qkv = a.qkv.data();
+            const float* probs = a.probs.data();
+            parallel::parallel_for(0, games * heads, parallel::grain_for(window * window * hd), [&](std::size_t lo, std::size_t hi) {
+                thread_local std::vector<float> row;
+                if (row.size() < window) row.resize(window);
+                for (std::size_t idx = lo; idx < hi; idx++) {
+                    const std::size_t g = idx / heads;
+                    const std::size_t head = idx % heads;
+                    const std::size_t base = offsets[g];
+                    const std::size_t col = head * hd;
+                    nn::attend_backward(qkv + base * 3 * d + col, qkv + base * 3 * d + d + col, qkv + base * 3 * d + 2 * d + col,
+                                        probs + (base * heads + head) * window, heads * window,
+                                        datt + base * d + col, d, 3 * d, offsets[g + 1] - base, hd,
+                                        dqkv + base * 3 * d + col, dqkv + base * 3 * d + d + col, dqkv + base * 3 * d + 2 * d + col,
+                                        row.data());
+                }
+            });
+            nn::linear_backward_params(a.ln1.data(), dqkv, gl.w_qkv.data(), gl.b_qkv.data(), tokens, d, 3 * d);
+            nn::linear_backward_input(dqkv, l.w_qkv.data(), dh, tokens, d, 3 * d);
+            nn::layer_norm_backward(a.x_in.data(), l.ln1_g.data(), dh, dh2, gl.ln1_g.data(), gl.ln1_b.data(), tokens, d, scratch);
+            nn::add(dx, dh2, tokens * d);
+            report(gl.ln1_g, gl.b_ff2);
+        }
+
+        // Input projection, event embeddings and positions.
+        nn::linear_backward_params(feats, dx, grads.w_in_.data(), grads.b_in_.data(), tokens, play::num_features, d);
+        float* dembed = grads.embed_.data();
+        float* dpos = grads.pos_.data();
+        for (std::size_t g = 0; g < games; g++) {
+            for (std::size_t r = offsets[g]; r < offsets[g + 1]; r++) {
+                float* de = dembed + ws.types_[r] * d;
+                float* dp = dpos + (r - offsets[g]) * d;
+                for (std::size_t j = 0; j < d; j++) {
+                    de[j] += dx[r * d + j];
+                    dp[j] += dx[r * d + j];
+                }
+            }
+        }
+        report(grads.embed_, grads.b_in_);
+        return loss;
+    }
+}
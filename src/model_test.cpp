@@ -0,0 +1,296 @@
+// model_test.cpp
+// Sanity tests for the play transformer: output distributions, batching and
+// checkpoint round trips.
+
+#include "../include/model.hpp"
+#include "../include/play.hpp"
+#include "../include/checkpoint.hpp"
+
+#include <iostream>
+#include <vector>
+#include <span>
+#include <cmath>
+#include <cassert>
+#include <cstdio>
+#include <random>
+
+using namespace std;
+using hml::model::transformer;
+using hml::model::workspace;
+using hml::model::prediction;
+using hml::model::kv_cache;
+using hml::model::train_workspace;
+using hml::play::play_event;
+
+static bool nearly_equal(float a, float b, float eps = 1e-5f) {
+    return std::fabs(a - b) <= eps;
+}
+
+static hml::model::config small_config() {
+    hml::model::config cfg;
+    cfg.d_model = 32;
+    cfg.n_heads = 4;
+    cfg.n_layers = 2;
+    cfg.d_ff = 64;
+    cfg.max_seq = 128;
+    return cfg;
+}
+
+static void expect_same(const prediction& a, const prediction& b, float eps = 1e-5f) {
+    assert(nearly_equal(a.win_prob, b.win_prob, eps));
+    for (size_t i = 0; i < a.next_event.size(); i++) {
+        assert(nearly_equal(a.next_event[i], b.next_event[i], eps));
+    }
+}
+
+static void test_forward_outputs() {
+    cout << "=== test_forward_outputs ===\n";
+
+    transformer model(small_config(), 7);
+    workspace ws(model.get_config(), 1, 128);
+    auto game = hml::play::synthetic_game(1, 40, 1);
+
+    vector<span<const play_event>> games{span<const play_event>(game)};
+    vector<prediction> out(1);
+    model.forward(games, ws, out);
+
+    assert(out[0].win_prob > 0.0f && out[0].win_prob < 1.0f);
+    float total = 0.0f;
+    for (float p : out[0].next_event) {
+        assert(p >= 0.0f);
+        total += p;
+    }
+    assert(nearly_equal(total, 1.0f, 1e-4f));
+
+    cout << "OK\n\n";
+}
+
+static void test_batch_matches_single() {
+    cout << "=== test_batch_matches_single ===\n";
+
+    transformer model(small_config(), 7);
+    auto a = hml::play::synthetic_game(1, 50, 1);
+    auto b = hml::play::synthetic_game(2, 13, 1);
+    auto c = hml::play::synthetic_game(3, 200, 1); // longer than max_seq: windowed
+
+    workspace ws(model.get_config(), 4, 4 * 128);
+    vector<span<const play_event>> batch{span<const play_event>(a), span<const play_event>(b),
+                                         span<const play_event>(c), span<const play_event>(a).first(20)};
+    vector<prediction> batched(4);
+    model.forward(batch, ws, batched);
+
+    for (size_t g = 0; g < batch.size(); g++) {
+        vector<span<const play_event>> one{batch[g]};
+        vector<prediction> single(1);
+        model.forward(one, ws, single);
+        expect_same(batched[g], single[0]);
+    }
+
+    bool threw = false;
+    try {
+        workspace tiny(model.get_config(), 1, 8);
+        vector<prediction> out(1);
+        vector<span<const play_event>> one{span<const play_event>(a)};
+        model.forward(one, tiny, out);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    assert(threw && "Expected forward() to reject a batch larger than the workspace");
+
+    cout << "OK\n\n";
+}
+
+static void test_checkpoint_roundtrip() {
+    cout << "=== test_checkpoint_roundtrip ===\n";
+
+    transformer model(small_config(), 11);
+    const string path = "model_test_checkpoint.bin";
+    model.save(path);
+
+    {
+        transformer loaded = transformer::load(path);
+        assert(loaded.get_config().d_model == 32 && loaded.get_config().n_layers == 2);
+
+        auto game = hml::play::synthetic_game(5, 60, 3);
+        workspace ws(model.get_config(), 1, 128);
+        vector<span<const play_event>> games{span<const play_event>(game)};
+        vector<prediction> want(1), got(1);
+        model.forward(games, ws, want);
+        loaded.forward(games, ws, got);
+        expect_same(want[0], got[0], 0.0f);
+    }
+
+    std::remove(path.c_str());
+    cout << "OK\n\n";
+}
+
+static void test_load_rejects_bad_config() {
+    cout << "=== test_load_rejects_bad_config ===\n";
+
+    transformer model(small_config(), 11);
+    const string path = "model_test_bad_config.bin";
+    model.save(path);
+
+    // Rewrite the checkpoint with each broken config in turn.
+    const float bad[][5] = {{30, 4, 2, 64, 128}, {32, 0, 2, 64, 128}, {0, 4, 2, 64, 128},
+                            {32, 4, 2, 0, 128}, {32, 4, 2, 64, 0}, {32, 4, -2, 64, 128}, {32.5f, 4, 2, 64, 128}};
+    for (const auto& values : bad) {
+        auto tensors = hml::checkpoint::load(path);
+        hml::tensor::tensor cfg{5};
+        for (size_t i = 0; i < 5; i++) cfg.data()[i] = values[i];
+        vector<hml::checkpoint::entry> entries;
+        for (const auto& [name, t] : tensors) entries.emplace_back(name, name == "config" ? &cfg : &t);
+        hml::checkpoint::save(path, entries);
+
+        bool threw = false;
+        try { transformer::load(path); } catch (const std::runtime_error&) { threw = true; }
+        assert(threw);
+    }
+
+    std::remove(path.c_str());
+    cout << "OK\n\n";
+}
+
+static void test_kv_cache_decode_matches_forward() {
+    cout << "=== test_kv_cache_decode_matches_forward ===\n";
+
+    transformer model(small_config(), 3);
+    workspace ws(model.get_config(), 3, 3 * 128);
+    auto a = hml::play::synthetic_game(1, 60, 9);
+    auto b = hml::play::synthetic_game(2, 60, 9);
+
+    // Two games decoded side by side, one play at a time.
+    kv_cache ca(model.get_config());
+    kv_cache cb(model.get_config());
+    vector<kv_cache*> caches{&ca, &cb};
+    for (size_t t = 0; t < a.size(); t++) {
+        vector<play_event> plays{a[t], b[t]};
+        vector<prediction> inc(2);
+        model.decode(plays, caches, ws, inc);
+        assert(ca.size() == t + 1 && cb.size() == t + 1);
+
+        vector<span<const play_event>> prefixes{span<const play_event>(a).first(t + 1),
+                                                span<const play_event>(b).first(t + 1)};
+        vector<prediction> full(2);
+        model.forward(prefixes, ws, full);
+        expect_same(inc[0], full[0], 1e-4f);
+        expect_same(inc[1], full[1], 1e-4f);
+    }
+
+    // Prefill a window, then keep decoding from it.
+    kv_cache cp(model.get_config());
+    vector<kv_cache*> one{&cp};
+    vector<span<const play_event>> window{span<const play_event>(a).first(30)};
+    vector<prediction> out(1);
+    model.prefill(window, one, ws, out);
+    assert(cp.size() == 30);
+    for (size_t t = 30; t < 40; t++) {
+        vector<play_event> play{a[t]};
+        model.decode(play, one, ws, out);
+        vector<span<const play_event>> prefix{span<const play_event>(a).first(t + 1)};
+        vector<prediction> full(1);
+        model.forward(prefix, ws, full);
+        expect_same(out[0], full[0], 1e-4f);
+    }
+
+    // A full cache refuses more plays.
+    auto longer = hml::play::synthetic_game(3, 128, 9);
+    vector<span<const play_event>> whole{span<const play_event>(longer)};
+    model.prefill(whole, one, ws, out);
+    assert(cp.size() == cp.capacity());
+    bool threw = false;
+    try {
+        vector<play_event> play{a[0]};
+        model.decode(play, one, ws, out);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    assert(threw && "Expected decode() to reject a full cache");
+
+    cout << "OK\n\n";
+}
+
+static void test_backward_matches_finite_differences() {
+    cout << "=== test_backward_matches_finite_differences ===\n";
+
+    hml::model::config cfg = small_config();
+    cfg.d_model = 16;
+    cfg.d_ff = 32;
+    cfg.max_seq = 32;
+    transformer model(cfg, 5);
+    model.flatten();
+    transformer grads = model.zeros_like();
+    assert(grads.parameters().size() == model.parameters().size());
+
+    // Weights around 1 rather than 0.02 so every path carries a visible gradient.
+    std::mt19937 rng(1);
+    std::normal_distribution<float> normal(0.0f, 0.3f);
+    for (float& p : model.parameters()) p += normal(rng);
+
+    auto a = hml::play::synthetic_game(1, 12, 4);
+    auto b = hml::play::synthetic_game(2, 7, 4);
+    vector<hml::model::sample> batch{{span<const play_event>(a), 1.0f}, {span<const play_event>(b), 0.0f}};
+    train_workspace ws(cfg, 2, 16);
+
+    vector<pair<size_t, size_t>> ready;
+    const float loss = model.train_batch(batch, ws, grads, [&](size_t lo, size_t hi) { ready.emplace_back(lo, hi); });
+    assert(std::isfinite(loss) && loss > 0.0f);
+
+    // Ranges arrive back to front and tile the whole buffer.
+    assert(ready.size() == cfg.n_layers + 2);
+    assert(ready.front().second == model.parameters().size() && ready.back().first == 0);
+    for (size_t i = 1; i < ready.size(); i++) assert(ready[i].second == ready[i - 1].first);
+
+    const vector<float> analytic(grads.parameters().begin(), grads.parameters().end());
+    transformer scratch = model.zeros_like();
+    auto loss_at = [&](size_t i, float v) {
+        const float saved = model.parameters()[i];
+        model.parameters()[i] = v;
+        const float l = model.train_batch(batch, ws, scratch);
+        model.parameters()[i] = saved;
+        return l;
+    };
+
+    std::uniform_int_distribution<size_t> pick(0, analytic.size() - 1);
+    size_t checked = 0;
+    for (int trial = 0; trial < 400 && checked < 60; trial++) {
+        const size_t i = pick(rng);
+        // Unused positions and event types have no gradient; skip most of them.
+        if (analytic[i] == 0.0f && trial % 8 != 0) continue;
+        const float h = 1e-2f;
+        const float p = model.parameters()[i];
+        const float numeric = (loss_at(i, p + h) - loss_at(i, p - h)) / (2.0f * h);
+        assert(std::fabs(numeric - analytic[i]) <= 2e-3f + 5e-2f * std::fabs(numeric));
+        checked++;
+    }
+    assert(checked >= 40);
+
+    // Flattening must not change what the model predicts.
+    transformer fresh(cfg, 5);
+    workspace fws(cfg, 1, 32);
+    vector<span<const play_event>> games{span<const play_event>(a)};
+    vector<prediction> before(1), after(1);
+    fresh.forward(games, fws, before);
+    fresh.flatten();
+    fresh.forward(games, fws, after);
+    expect_same(before[0], after[0], 0.0f);
+
+    cout << "OK\n\n";
+}
+
+int main() {
+    try {
+        test_forward_outputs();
+        test_batch_matches_single();
+        test_checkpoint_roundtrip();
+        test_load_rejects_bad_config();
+        test_kv_cache_decode_matches_forward();
+        test_backward_matches_finite_differences();
+
+        cout << "ALL TESTS PASSED ✅\n";
+    } catch (const std::exception& e) {
+        cerr << "Unhandled exception: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,241 @@
+#include "../include/nn.hpp"
+#include "../include/thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace hml::nn {
+    void linear(const float* x, const float* w, const float* b, float* y,
+                std::size_t n, std::size_t in, std::size_t out) {
+        parallel::parallel_for(0, n, parallel::grain_for(in * out), [=](std::size_t lo, std::size_t hi) {
+            // Four rows share each pass over w, so w streams through cache a quarter as often.
+            std::size_t i = lo;
+            for (; i + 4 <= hi; i += 4) {
+                float* y0 = y + (i + 0) * out;
+                float* y1 = y + (i + 1) * out;
+                float* y2 = y + (i + 2) * out;
+                float* y3 = y + (i + 3) * out;
+                for (std::size_t j = 0; j < out; j++) {
+                    const float bj = b ? b[j] : 0.0f;
+                    y0[j] = bj; y1[j] = bj; y2[j] = bj; y3[j] = bj;
+                }
+                for (std::size_t k = 0; k < in; k++) {
+                    const float* wk = w + k * out;
+                    const float x0 = x[(i + 0) * in + k];
+                    const float x1 = x[(i + 1) * in + k];
+                    const float x2 = x[(i + 2) * in + k];
+                    const float x3 = x[(i + 3) * in + k];
+                    for (std::size_t j = 0; j < out; j++) {
+                        const float wj = wk[j];
+                        y0[j] += x0 * wj; y1[j] += x1 * wj; y2[j] += x2 * wj; y3[j] += x3 * wj;
+                    }
+                }
+            }
+            for (; i < hi; i++) {
+                float* yi = y + i * out;
+                for (std::size_t j = 0; j < out; j++) yi[j] = b ? b[j] : 0.0f;
+                for (std::size_t k = 0; k < in; k++) {
+                    const float* wk = w + k * out;
+                    const float xk = x[i * in + k];
+                    for (std::size_t j = 0; j < out; j++) yi[j] += xk * wk[j];
+                }
+            }
+        });
+    }
+
+    void layer_norm(const float* x, const float* gamma, const float* beta, float* y,
+                    std::size_t n, std::size_t d) {
+        parallel::parallel_for(0, n, parallel::grain_for(d), [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = lo; i < hi; i++) {
+                const float* xi = x + i * d;
+                float* yi = y + i * d;
+                float mean = 0.0f;
+                for (std::size_t j = 0; j < d; j++) mean += xi[j];
+                mean /= static_cast<float>(d);
+                float var = 0.0f;
+                for (std::size_t j = 0; j < d; j++) var += (xi[j] - mean) * (xi[j] - mean);
+                const float inv = 1.0f / std::sqrt(var / static_cast<float>(d) + 1e-5f);
+                for (std::size_t j = 0; j < d; j++) yi[j] = (xi[j] - mean) * inv * gamma[j] + beta[j];
+            }
+        });
+    }
+
+    void gelu(float* x, std::size_t n) {
+        parallel::parallel_for(0, n, parallel::default_grain, [=](std::size_t lo, std::size_t hi) {
+            constexpr float c = 0.7978845608f; // sqrt(2 / pi)
+            for (std::size_t i = lo; i < hi; i++) {
+                const float v = x[i];
+                x[i] = 0.5f * v * (1.0f + std::tanh(c * (v + 0.044715f * v * v * v)));
+            }
+        });
+    }
+
+    void add(float* y, const float* x, std::size_t n) {
+        parallel::parallel_for(0, n, parallel::default_grain, [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = lo; i < hi; i++) y[i] += x[i];
+        });
+    }
+
+    void softmax(float* x, std::size_t n) {
+        if (n == 0) return;
+        const float m = *std::max_element(x, x + n);
+        float total = 0.0f;
+        for (std::size_t i = 0; i < n; i++) {
+            x[i] = std::exp(x[i] - m);
+            total += x[i];
+        }
+        const float inv = 1.0f / total;
+        for (std::size_t i = 0; i < n; i++) x[i] *= inv;
+    }
+
+    void attend(const float* q, const float* k, const float* v, std::size_t stride, std::size_t len,
+                std::size_t head_dim, float* out, float* scratch) {
+        const float scale = 1.0f / std::sqrt(static_cast<float>(head_dim));
+        for (std::size_t j = 0; j < len; j++) {
+            const float* kj = k + j * stride;
+            float dot = 0.0f;
+            for (std::size_t t = 0; t < head_dim; t++) dot += q[t] * kj[t];
+            scratch[j] = dot * scale;
+        }
+        softmax(scratch, len);
+        std::fill(out, out + head_dim, 0.0f);
+        for (std::size_t j = 0; j < len; j++) {
+            const float* vj = v + j * stride;
+            const float p = scratch[j];
+            for (std::size_t t = 0; t < head_dim; t++) out[t] += p * vj[t];
+        }
+    }
+
+    void linear_backward_params(const float* x, const float* dy, float* dw, float* db,
+                                std::size_t n, std::size_t in, std::size_t out) {
+        // Each task owns a band of dw rows, so no two threads touch the same gradient.
+        parallel::parallel_for(0, in, parallel::grain_for(n * out), [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = 0; i < n; i++) {
+                const float* dyi = dy + i * out;
+                const float* xi = x + i * in;
+                for (std::size_t k = lo; k < hi; k++) {
+                    const float xk = xi[k];
+                    float* dwk = dw + k * out;
+                    for (std::size_t j = 0; j < out; j++) dwk[j] += xk * dyi[j];
+                }
+            }
+        });
+        if (db == nullptr) return;
+        parallel::parallel_for(0, out, parallel::grain_for(n), [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = 0; i < n; i++) {
+                const float* dyi = dy + i * out;
+                for (std::size_t j = lo; j < hi; j++) db[j] += dyi[j];
+            }
+        });
+    }
+
+    void linear_backward_input(const float* dy, const float* w, float* dx,
+                               std::size_t n, std::size_t in, std::size_t out) {
+        parallel::parallel_for(0, n, parallel::grain_for(in * out), [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = lo; i < hi; i++) {
+                const float* dyi = dy + i * out;
+                float* dxi = dx + i * in;
+                for (std::size_t k = 0; k < in; k++) {
+                    const float* wk = w + k * out;
+                    float acc = 0.0f;
+                    for (std::size_t j = 0; j < out; j++) acc += dyi[j] * wk[j];
+                    dxi[k] = acc;
+                }
+            }
+        });
+    }
+
+    void layer_norm_backward(const float* x, const float* gamma, const float* dy, float* dx,
+                             float* dgamma, float* dbeta, std::size_t n, std::size_t d, float* scratch) {
+        float* mean = scratch;
+        float* rstd = scratch + n;
+        const float inv_d = 1.0f / static_cast<float>(d);
+        parallel::parallel_for(0, n, parallel::grain_for(d), [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = lo; i < hi; i++) {
+                const float* xi = x + i * d;
+                const float* dyi = dy + i * d;
+                float m = 0.0f;
+                for (std::size_t j = 0; j < d; j++) m += xi[j];
+                m *= inv_d;
+                float var = 0.0f;
+                for (std::size_t j = 0; j < d; j++) var += (xi[j] - m) * (xi[j] - m);
+                const float r = 1.0f / std::sqrt(var * inv_d + 1e-5f);
+                mean[i] = m;
+                rstd[i] = r;
+
+                // dx = rstd * (g - mean(g) - xhat * mean(g * xhat)), g = dy * gamma
+                float g_mean = 0.0f;
+                float gx_mean = 0.0f;
+                for (std::size_t j = 0; j < d; j++) {
+                    const float g = dyi[j] * gamma[j];
+                    g_mean += g;
+                    gx_mean += g * (xi[j] - m) * r;
+                }
+                g_mean *= inv_d;
+                gx_mean *= inv_d;
+                float* dxi = dx + i * d;
+                for (std::size_t j = 0; j < d; j++) {
+                    dxi[j] = r * (dyi[j] * gamma[j] - g_mean - (xi[j] - m) * r * gx_mean);
+                }
+            }
+        });
+        parallel::parallel_for(0, d, parallel::grain_for(n), [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = 0; i < n; i++) {
+                const float* xi = x + i * d;
+                const float* dyi = dy + i * d;
+                for (std::size_t j = lo; j < hi; j++) {
+                    dgamma[j] += dyi[j] * (xi[j] - mean[i]) * rstd[i];
+                    dbeta[j] += dyi[j];
+                }
+            }
+        });
+    }
+
+    void gelu_backward(const float* x, float* dy, std::size_t n) {
+        parallel::parallel_for(0, n, parallel::default_grain, [=](std::size_t lo, std::size_t hi) {
+            constexpr float c = 0.7978845608f; // sqrt(2 / pi)
+            for (std::size_t i = lo; i < hi; i++) {
+                const float v = x[i];
+                const float t = std::tanh(c * (v + 0.044715f * v * v * v));
+                dy[i] *= 0.5f * (1.0f + t) + 0.5f * v * (1.0f - t * t) * c * (1.0f + 3.0f * 0.044715f * v * v);
+            }
+        });
+    }
+
+    void attend_backward(const float* q, const float* k, const float* v, const float* probs, std::size_t prob_stride,
+                         const float* dout, std::size_t out_stride, std::size_t stride, std::size_t len,
+                         std::size_t head_dim, float* dq, float* dk, float* dv, float* scratch) {
+        const float scale = 1.0f / std::sqrt(static_cast<float>(head_dim));
+        for (std::size_t j = 0; j < len; j++) {
+            std::fill_n(dk + j * stride, head_dim, 0.0f);
+            std::fill_n(dv + j * stride, head_dim, 0.0f);
+        }
+        for (std::size_t t = 0; t < len; t++) {
+            const float* p = probs + t * prob_stride;
+            const float* dot = dout + t * out_stride;
+            const float* qt = q + t * stride;
+            float* dqt = dq + t * stride;
+
+            // dP_j = dout . v_j, then through the softmax: dS_j = P_j (dP_j - sum_i P_i dP_i).
+            float weighted = 0.0f;
+            for (std::size_t j = 0; j <= t; j++) {
+                const float* vj = v + j * stride;
+                float acc = 0.0f;
+                for (std::size_t e = 0; e < head_dim; e++) acc += dot[e] * vj[e];
+                scratch[j] = acc;
+                weighted += p[j] * acc;
+            }
+            std::fill_n(dqt, head_dim, 0.0f);
+            for (std::size_t j = 0; j <= t; j++) {
+                const float ds = p[j] * (scratch[j] - weighted) * scale;
+                const float* kj = k + j * stride;
+                float* dkj = dk + j * stride;
+                float* dvj = dv + j * stride;
+                for (std::size_t e = 0; e < head_dim; e++) {
+                    dqt[e] += ds * kj[e];
+                    dkj[e] += ds * qt[e];
+                    dvj[e] += p[j] * dot[e];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,164 @@
+#include "../include/optimizer.hpp"
+#include "../include/thread_pool.hpp"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace hml::optim {
+    method parse_method(std::string_view name) {
+        if (name == "sgd") return method::sgd;
+        if (name == "adam") return method::adam;
+        if (name == "adamw") return method::adamw;
+        throw std::invalid_argument("optim: unknown optimizer " + std::string(name));
+    }
+
+    // Per-step constants for the update kernels. The gradient entering every
+    // update is g * scale + l2 * p, where scale applies clipping.
+    struct coeffs {
+        float scale = 1.0f;
+        float l2 = 0.0f;
+        float lr = 0.0f;
+        float momentum = 0.0f;
+        float decay = 1.0f;          // adamw: p *= 1 - lr * weight_decay
+        float beta1 = 0.0f, beta2 = 0.0f;
+        float step_size = 0.0f;      // lr / (1 - beta1^t)
+        float inv_sqrt_bc2 = 1.0f;   // 1 / sqrt(1 - beta2^t)
+        float eps = 0.0f;
+    };
+
+    static void sgd_kernel(float* p, const float* g, float* buf, std::size_t lo, std::size_t hi, const coeffs& c) {
+        std::size_t i = lo;
+#if defined(__AVX__)
+        const __m256 scale = _mm256_set1_ps(c.scale), l2 = _mm256_set1_ps(c.l2);
+        const __m256 lr = _mm256_set1_ps(c.lr), mu = _mm256_set1_ps(c.momentum);
+        for (; i + 8 <= hi; i += 8) {
+            const __m256 pv = _mm256_loadu_ps(p + i);
+            __m256 gv = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(g + i), scale), _mm256_mul_ps(pv, l2));
+            if (buf) {
+                gv = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(buf + i), mu), gv);
+                _mm256_storeu_ps(buf + i, gv);
+            }
+            _mm256_storeu_ps(p + i, _mm256_sub_ps(pv, _mm256_mul_ps(gv, lr)));
+        }
+#endif
+        for (; i < hi; i++) {
+            float gi = g[i] * c.scale + p[i] * c.l2;
+            if (buf) gi = buf[i] = buf[i] * c.momentum + gi;
+            p[i] -= gi * c.lr;
+        }
+    }
+
+    static void adam_kernel(float* p, const float* g, float* m, float* v, std::size_t lo, std::size_t hi, const coeffs& c) {
+        const float one_b1 = 1.0f - c.beta1, one_b2 = 1.0f - c.beta2;
+        std::size_t i = lo;
+#if defined(__AVX__)
+        const __m256 scale = _mm256_set1_ps(c.scale), l2 = _mm256_set1_ps(c.l2), decay = _mm256_set1_ps(c.decay);
+        const __m256 b1 = _mm256_set1_ps(c.beta1), b2 = _mm256_set1_ps(c.beta2);
+        const __m256 nb1 = _mm256_set1_ps(one_b1), nb2 = _mm256_set1_ps(one_b2);
+        const __m256 step = _mm256_set1_ps(c.step_size), ibc2 = _mm256_set1_ps(c.inv_sqrt_bc2), eps = _mm256_set1_ps(c.eps);
+        for (; i + 8 <= hi; i += 8) {
+            const __m256 pv = _mm256_loadu_ps(p + i);
+            const __m256 gv = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(g + i), scale), _mm256_mul_ps(pv, l2));
+            const __m256 mv = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(m + i), b1), _mm256_mul_ps(gv, nb1));
+            const __m256 vv = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(v + i), b2), _mm256_mul_ps(_mm256_mul_ps(gv, gv), nb2));
+            _mm256_storeu_ps(m + i, mv);
+            _mm256_storeu_ps(v + i, vv);
+            const __m256 denom = _mm256_add_ps(_mm256_mul_ps(_mm256_sqrt_ps(vv), ibc2), eps);
+            _mm256_storeu_ps(p + i, _mm256_sub_ps(_mm256_mul_ps(pv, decay), _mm256_div_ps(_mm256_mul_ps(mv, step), denom)));
+        }
+#endif
+        for (; i < hi; i++) {
+            const float gi = g[i] * c.scale + p[i] * c.l2;
+            const float mi = m[i] = m[i] * c.beta1 + gi * one_b1;
+            const float vi = v[i] = v[i] * c.beta2 + gi * gi * one_b2;
+            p[i] = p[i] * c.decay - mi * c.step_size / (std::sqrt(vi) * c.inv_sqrt_bc2 + c.eps);
+        }
+    }
+
+    float l2_norm(std::span<const float> grads) {
+        const float* g = grads.data();
+        const double sum = parallel::parallel_reduce(std::size_t{0}, grads.size(), parallel::default_grain, 0.0,
+            [=](std::size_t lo, std::size_t hi) {
+                std::size_t i = lo;
+                double s = 0.0;
+#if defined(__AVX__)
+                __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+                for (; i + 16 <= hi; i += 16) {
+                    const __m256 a = _mm256_loadu_ps(g + i), b = _mm256_loadu_ps(g + i + 8);
+                    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(a, a));
+                    acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(b, b));
+                }
+                alignas(32) float lanes[8];
+                _mm256_store_ps(lanes, _mm256_add_ps(acc0, acc1));
+                for (float l : lanes) s += l;
+#endif
+                for (; i < hi; i++) s += static_cast<double>(g[i]) * g[i];
+                return s;
+            },
+            [](double a, double b) { return a + b; });
+        return static_cast<float>(std::sqrt(sum));
+    }
+
+    optimizer::optimizer(std::size_t size, const options& opts) : opts_(opts), size_(size) {
+        if (!(opts.lr >= 0.0f) || opts.clip_norm < 0.0f || opts.weight_decay < 0.0f)
+            throw std::invalid_argument("optim: lr, clip_norm and weight_decay must be non-negative");
+        if (opts.type == method::sgd) {
+            if (opts.momentum != 0.0f) m_.assign(size, 0.0f);
+        } else {
+            if (!(opts.beta1 >= 0.0f && opts.beta1 < 1.0f && opts.beta2 >= 0.0f && opts.beta2 < 1.0f))
+                throw std::invalid_argument("optim: betas must be in [0, 1)");
+            m_.assign(size, 0.0f);
+            v_.assign(size, 0.0f);
+        }
+    }
+
+    std::size_t optimizer::size() const noexcept { return size_; }
+    std::uint64_t optimizer::steps() const noexcept { return steps_; }
+    const options& optimizer::get_options() const noexcept { return opts_; }
+    void optimizer::set_lr(float lr) noexcept { opts_.lr = lr; }
+
+    float optimizer::step(std::span<float> params, std::span<const float> grads) {
+        if (params.size() != size_ || grads.size() != size_) throw std::invalid_argument("optim: buffers do not match the optimizer size");
+        coeffs c;
+        c.lr = opts_.lr;
+        float norm = 0.0f;
+        if (opts_.clip_norm > 0.0f) {
+            norm = l2_norm(grads);
+            // clip / inf would zero the gradient and clip / NaN poison every weight
+            // and moment; refuse before anything is touched.
+            if (!std::isfinite(norm)) throw std::runtime_error("optim: gradient norm is not finite");
+            if (norm > opts_.clip_norm) c.scale = opts_.clip_norm / norm;
+        }
+        steps_++;
+
+        float* p = params.data();
+        const float* g = grads.data();
+        if (opts_.type == method::sgd) {
+            c.l2 = opts_.weight_decay;
+            c.momentum = opts_.momentum;
+            float* buf = m_.empty() ? nullptr : m_.data();
+            parallel::parallel_for(0, size_, parallel::default_grain, [&](std::size_t lo, std::size_t hi) {
+                sgd_kernel(p, g, buf, lo, hi, c);
+            });
+            return norm;
+        }
+
+        const double t = static_cast<double>(steps_);
+        c.beta1 = opts_.beta1;
+        c.beta2 = opts_.beta2;
+        c.eps = opts_.eps;
+        c.step_size = static_cast<float>(opts_.lr / (1.0 - std::pow(static_cast<double>(opts_.beta1), t)));
+        c.inv_sqrt_bc2 = static_cast<float>(1.0 / std::sqrt(1.0 - std::pow(static_cast<double>(opts_.beta2), t)));
+        if (opts_.type == method::adamw) c.decay = 1.0f - opts_.lr * opts_.weight_decay;
+        else c.l2 = opts_.weight_decay;
+        float* m = m_.data();
+        float* v = v_.data();
+        parallel::parallel_for(0, size_, parallel::default_grain, [&](std::size_t lo, std::size_t hi) {
+            adam_kernel(p, g, m, v, lo, hi, c);
+        });
+        return norm;
+    }
+}
@@ -0,0 +1,159 @@
+// optimizer_test.cpp
+// Tests for the fused optimizers against straightforward double precision
+// versions of the textbook updates, including clipping and weight decay.
+
+#include "../include/optimizer.hpp"
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <cassert>
+
+using namespace std;
+namespace optim = hml::optim;
+
+// Unfused reference: one optimizer, element by element, in double.
+struct reference {
+    optim::options opts;
+    vector<double> m, v;
+    int t = 0;
+
+    void step(vector<double>& p, const vector<double>& grad) {
+        t++;
+        double norm = 0.0;
+        for (double g : grad) norm += g * g;
+        norm = sqrt(norm);
+        const double scale = opts.clip_norm > 0.0f && norm > opts.clip_norm ? opts.clip_norm / norm : 1.0;
+        if (m.empty()) m.assign(p.size(), 0.0), v.assign(p.size(), 0.0);
+
+        for (size_t i = 0; i < p.size(); i++) {
+            double g = grad[i] * scale;
+            if (opts.type == optim::method::sgd) {
+                g += opts.weight_decay * p[i];
+                if (opts.momentum != 0.0f) g = m[i] = opts.momentum * m[i] + g;
+                p[i] -= opts.lr * g;
+                continue;
+            }
+            if (opts.type == optim::method::adamw) p[i] -= opts.lr * opts.weight_decay * p[i];
+            else g += opts.weight_decay * p[i];
+            m[i] = opts.beta1 * m[i] + (1.0 - opts.beta1) * g;
+            v[i] = opts.beta2 * v[i] + (1.0 - opts.beta2) * g * g;
+            const double m_hat = m[i] / (1.0 - pow(opts.beta1, t));
+            const double v_hat = v[i] / (1.0 - pow(opts.beta2, t));
+            p[i] -= opts.lr * m_hat / (sqrt(v_hat) + opts.eps);
+        }
+    }
+};
+
+static void check_against_reference(const optim::options& opts, size_t n, mt19937& rng) {
+    normal_distribution<float> dist(0.0f, 1.0f);
+    vector<float> params(n), grads(n);
+    for (auto& x : params) x = dist(rng);
+    vector<double> want(params.begin(), params.end());
+
+    optim::optimizer opt(n, opts);
+    reference ref;
+    ref.opts = opts;
+    for (int step = 0; step < 6; step++) {
+        for (auto& g : grads) g = dist(rng) * 0.5f;
+        const float norm = opt.step(params, grads);
+        ref.step(want, vector<double>(grads.begin(), grads.end()));
+
+        if (opts.clip_norm > 0.0f) {
+            double sq = 0.0;
+            for (float g : grads) sq += static_cast<double>(g) * g;
+            assert(std::fabs(norm - sqrt(sq)) <= 1e-5 * sqrt(sq));
+        } else {
+            assert(norm == 0.0f);
+        }
+        for (size_t i = 0; i < n; i++) assert(std::fabs(params[i] - want[i]) <= 1e-6 + 1e-5 * std::fabs(want[i]));
+    }
+    assert(opt.steps() == 6);
+}
+
+static void test_matches_reference() {
+    cout << "=== test_matches_reference ===\n";
+
+    mt19937 rng(5);
+    for (auto type : {optim::method::sgd, optim::method::adam, optim::method::adamw}) {
+        for (float decay : {0.0f, 0.1f}) {
+            for (float clip : {0.0f, 1.0f}) {
+                optim::options opts;
+                opts.type = type;
+                opts.lr = type == optim::method::sgd ? 0.05f : 1e-2f;
+                opts.weight_decay = decay;
+                opts.clip_norm = clip;
+                // Odd sizes exercise the scalar tail; the large one spans several pool chunks.
+                for (size_t n : {1, 7, 8, 100003}) check_against_reference(opts, n, rng);
+            }
+        }
+    }
+    optim::options plain;
+    plain.type = optim::method::sgd;
+    plain.momentum = 0.0f;
+    check_against_reference(plain, 1000, rng);
+
+    cout << "OK\n\n";
+}
+
+static void test_clipping_and_errors() {
+    cout << "=== test_clipping_and_errors ===\n";
+
+    // A step with a clipped gradient equals a step with the gradient scaled by hand.
+    optim::options opts;
+    opts.type = optim::method::sgd;
+    opts.momentum = 0.0f;
+    opts.lr = 1.0f;
+    opts.clip_norm = 2.0f;
+    vector<float> params(4, 0.0f), grads{3.0f, 0.0f, 4.0f, 0.0f};
+    optim::optimizer opt(params.size(), opts);
+    const float norm = opt.step(params, grads);
+    assert(norm == 5.0f);
+    assert(std::fabs(params[0] + 1.2f) < 1e-6f && std::fabs(params[2] + 1.6f) < 1e-6f && params[1] == 0.0f);
+
+    // Gradients already inside the bound are left alone.
+    vector<float> small{0.5f, 0.0f, 0.0f, 0.0f};
+    opt.step(params, small);
+    assert(std::fabs(params[0] + 1.7f) < 1e-6f);
+
+    vector<float> big(100003);
+    for (size_t i = 0; i < big.size(); i++) big[i] = static_cast<float>(i % 7) - 3.0f;
+    double sq = 0.0;
+    for (float g : big) sq += static_cast<double>(g) * g;
+    assert(std::fabs(optim::l2_norm(big) - sqrt(sq)) < 1e-4 * sqrt(sq));
+
+    // A non-finite gradient is refused without touching the weights.
+    for (float bad : {numeric_limits<float>::infinity(), numeric_limits<float>::quiet_NaN()}) {
+        const vector<float> kept = params;
+        const uint64_t steps = opt.steps();
+        vector<float> broken{0.1f, bad, 0.0f, 0.0f};
+        bool refused = false;
+        try { opt.step(params, broken); } catch (const std::runtime_error&) { refused = true; }
+        assert(refused && params == kept && opt.steps() == steps);
+    }
+
+    bool threw = false;
+    try { opt.step(params, vector<float>(3)); } catch (const std::invalid_argument&) { threw = true; }
+    assert(threw);
+    threw = false;
+    try { optim::parse_method("rmsprop"); } catch (const std::invalid_argument&) { threw = true; }
+    assert(threw);
+    assert(optim::parse_method("adamw") == optim::method::adamw);
+
+    cout << "OK\n\n";
+}
+
+int main() {
+    try {
+        test_matches_reference();
+        test_clipping_and_errors();
+
+        cout << "ALL TESTS PASSED ✅\n";
+    } catch (const std::exception& e) {
+        cerr << "Unhandled exception: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
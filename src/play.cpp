@@ -0,0 +1,168 @@
+#include "../include/play.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace hml::play {
+    std::size_t event_index(std::uint16_t type_code) noexcept {
+        auto it = std::find(event_types.begin(), event_types.end(), type_code);
+        return it == event_types.end() ? 0 : static_cast<std::size_t>(it - event_types.begin()) + 1;
+    }
+
+    static std::uint16_t parse_clock(const std::string& mmss) {
+        auto colon = mmss.find(':');
+        if (colon == std::string::npos) return 0;
+        try {
+            return static_cast<std::uint16_t>(std::stoi(mmss.substr(0, colon)) * 60 + std::stoi(mmss.substr(colon + 1)));
+        } catch (const std::exception&) {
+            return 0;
+        }
+    }
+
+    play_event parse_play(const json& play) {
+        play_event p;
+        p.event_id = play.value("eventId", 0);
+        p.type_code = static_cast<std::uint16_t>(play.value("typeCode", 0));
+        p.period = static_cast<std::uint8_t>(play.value("periodDescriptor", json::object()).value("number", 0));
+        p.seconds = parse_clock(play.value("timeInPeriod", std::string{}));
+
+        if (auto it = play.find("situationCode"); it != play.end()) {
+            if (it->is_string()) {
+                const std::string situation = it->get<std::string>();
+                if (situation.size() == 4 && std::all_of(situation.begin(), situation.end(), ::isdigit)) {
+                    p.situation = static_cast<std::uint16_t>(std::stoi(situation));
+                }
+            } else if (it->is_number_unsigned()) {
+                p.situation = static_cast<std::uint16_t>(it->get<unsigned>());
+            }
+        }
+
+        const json details = play.value("details", json::object());
+        if (details.contains("xCoord") && details.contains("yCoord")) {
+            p.x = static_cast<std::int16_t>(details.value("xCoord", 0));
+            p.y = static_cast<std::int16_t>(details.value("yCoord", 0));
+            p.flags |= has_coords;
+        }
+        if (details.contains("homeScore") && details.contains("awayScore")) {
+            p.home_score = static_cast<std::uint8_t>(details.value("homeScore", 0));
+            p.away_score = static_cast<std::uint8_t>(details.value("awayScore", 0));
+            p.flags |= has_score;
+        }
+        p.team_id = details.value("eventOwnerTeamId", 0);
+
+        for (const char* key : {"shootingPlayerId", "scoringPlayerId", "hittingPlayerId", "winningPlayerId",
+                                "committedByPlayerId", "playerId", "blockingPlayerId"}) {
+            if (details.contains(key)) {
+                p.player_id = details.value(key, 0);
+                break;
+            }
+        }
+
+        const std::string zone_code = details.value("zoneCode", std::string{});
+        if (zone_code == "O") p.zone_code = zone::offensive;
+        else if (zone_code == "D") p.zone_code = zone::defensive;
+        else if (zone_code == "N") p.zone_code = zone::neutral;
+        return p;
+    }
+
+    void append_play(std::vector<play_event>& history, play_event p) {
+        if (!(p.flags & has_score) && !history.empty()) {
+            p.home_score = history.back().home_score;
+            p.away_score = history.back().away_score;
+        }
+        history.push_back(p);
+    }
+
+    std::vector<std::vector<play_event>> read_season(const std::string& path, int year) {
+        std::vector<std::vector<play_event>> games;
+        std::ifstream inFile(path, std::ios::binary);
+        if (!inFile.is_open()) {
+            std::cerr << "Error opening file " << path << "\n";
+            return games;
+        }
+
+        std::string line;
+        while (std::getline(inFile, line)) {
+            if (line.empty()) continue;
+            // Each game starts with a "home: XXX away: YYY" line followed by one JSON play per line.
+            if (line.starts_with("home:")) {
+                games.emplace_back();
+                continue;
+            }
+            if (games.empty()) continue;
+            try {
+                play_event p = parse_play(json::parse(line));
+                p.game_id = static_cast<std::uint32_t>(year) * 1000000u + 20000u + static_cast<std::uint32_t>(games.size());
+                append_play(games.back(), p);
+            } catch (const json::exception& e) {
+                std::cerr << "Skipping bad play in " << path << ": " << e.what() << "\n";
+            }
+        }
+        std::erase_if(games, [](const auto& g) { return g.empty(); });
+        return games;
+    }
+
+    std::vector<play_event> synthetic_game(std::uint32_t game_id, std::size_t num_plays, std::uint64_t seed) {
+        std::mt19937_64 rng(seed ^ game_id);
+        std::uniform_int_distribution<std::size_t> type(0, event_types.size() - 1);
+        std::uniform_int_distribution<int> x(-99, 99);
+        std::uniform_int_distribution<int> y(-42, 42);
+        std::uniform_int_distribution<int> team(0, 1);
+
+        std::vector<play_event> game;
+        game.reserve(num_plays);
+        std::uint8_t home = 0;
+        std::uint8_t away = 0;
+        for (std::size_t i = 0; i < num_plays; i++) {
+            play_event p;
+            p.game_id = game_id;
+            p.event_id = static_cast<std::int32_t>(i + 1);
+            p.period = static_cast<std::uint8_t>(1 + std::min<std::size_t>(2, i * 3 / std::max<std::size_t>(num_plays, 1)));
+            p.seconds = static_cast<std::uint16_t>((i * 3600 / std::max<std::size_t>(num_plays, 1)) % 1200);
+            p.type_code = i + 1 == num_plays ? game_end_code : event_types[type(rng)];
+            if (p.type_code == game_end_code && i + 1 != num_plays) p.type_code = 520;
+            p.situation = 1551;
+            p.team_id = team(rng) ? 10 : 8;
+            p.player_id = 8470000 + static_cast<std::int32_t>(rng() % 800);
+            p.x = static_cast<std::int16_t>(x(rng));
+            p.y = static_cast<std::int16_t>(y(rng));
+            p.flags = has_coords;
+            p.zone_code = static_cast<zone>(1 + rng() % 3);
+            if (p.type_code == 505) {
+                (p.team_id == 10 ? home : away)++;
+                p.flags |= has_score;
+            }
+            p.home_score = home;
+            p.away_score = away;
+            game.push_back(p);
+        }
+        return game;
+    }
+
+    void encode_features(const play_event& p, float* out) noexcept {
+        // situationCode digits: away goalie, away skaters, home skaters, home goalie.
+        const int away_goalie = p.situation / 1000;
+        const int away_skaters = (p.situation / 100) % 10;
+        const int home_skaters = (p.situation / 10) % 10;
+        const int home_goalie = p.situation % 10;
+        const int diff = std::clamp(static_cast<int>(p.home_score) - static_cast<int>(p.away_score), -3, 3);
+
+        out[0] = static_cast<float>(p.period) / 3.0f;
+        out[1] = static_cast<float>(p.seconds) / 1200.0f;
+        out[2] = static_cast<float>(p.x) / 100.0f;
+        out[3] = static_cast<float>(p.y) / 42.5f;
+        out[4] = (p.flags & has_coords) ? 1.0f : 0.0f;
+        out[5] = static_cast<float>(diff) / 3.0f;
+        out[6] = p.situation ? static_cast<float>(home_skaters - away_skaters) / 2.0f : 0.0f;
+        out[7] = static_cast<float>(away_goalie);
+        out[8] = static_cast<float>(home_goalie);
+        out[9] = p.zone_code == zone::offensive ? 1.0f : 0.0f;
+        out[10] = p.zone_code == zone::defensive ? 1.0f : 0.0f;
+        out[11] = p.zone_code == zone::neutral ? 1.0f : 0.0f;
+    }
+}
@@ -0,0 +1,278 @@
+// Ad-hoc aggregate queries over the season column files.
+//
+//   PlayQuery ingest --data-dir ../data --seasons 2013-2024
+//   PlayQuery run --seasons 2013-2024 --where type=505,506,507 --where net_dist<=25
+//                 --group-by season,team,situation --select count,avg:net_dist --order 0 --limit 20
+//   PlayQuery synth --data-dir /tmp/plays --seasons 2013-2024     (synthetic files for benchmarking)
+//   PlayQuery heatmap --seasons 2013-2024 --player 8478402 --types 505,506,507 --fold
+//   PlayQuery region --seasons 2023 --rect 54,-22,89,22 --types 505,506
+//   PlayQuery near --seasons 2023 --at 80,0 --k 5 --types 505
+
+#include "../include/play_store.hpp"
+#include "../include/query.hpp"
+#include "../include/spatial_index.hpp"
+#include "../include/thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace store = hml::store;
+namespace query = hml::query;
+namespace spatial = hml::spatial;
+
+static void usage() {
+    std::cerr << "usage: PlayQuery <command> [options]\n"
+                 "  ingest [--data-dir DIR] --seasons Y[-Y]                 rebuild column files from pbp files\n"
+                 "  synth  [--data-dir DIR] --seasons Y[-Y] [--games N] [--plays N]\n"
+                 "                                                         write synthetic column files\n"
+                 "  run    [--data-dir DIR] --seasons Y[-Y] [--where PRED]... [--group-by COLS]\n"
+                 "         [--select AGGS] [--order N] [--asc] [--limit N]\n"
+                 "  heatmap [--data-dir DIR] --seasons Y[-Y] [--player ID] [--types CODES] [--fold]\n"
+                 "  region  [--data-dir DIR] --seasons Y[-Y] --rect X0,Y0,X1,Y1 [--types CODES]\n"
+                 "  near    [--data-dir DIR] --seasons Y[-Y] --at X,Y [--k N] [--types CODES]\n"
+                 "\n"
+                 "  PRED  column=v[,v|a..b]...  column!=...  column<v  <=  >  >=\n"
+                 "  AGGS  count,sum:col,avg:col,min:col,max:col\n"
+                 "  columns:";
+    for (const auto& c : store::columns) std::cerr << " " << c.name;
+    std::cerr << "\n";
+}
+
+static std::vector<std::string_view> split(std::string_view text) {
+    std::vector<std::string_view> out;
+    while (!text.empty()) {
+        const std::size_t comma = text.find(',');
+        out.push_back(text.substr(0, comma));
+        if (comma == std::string_view::npos) break;
+        text.remove_prefix(comma + 1);
+    }
+    return out;
+}
+
+static std::vector<int> split_ints(std::string_view text, std::size_t expected) {
+    std::vector<int> out;
+    for (auto v : split(text)) out.push_back(std::stoi(std::string(v)));
+    if (expected != 0 && out.size() != expected) throw std::invalid_argument("expected " + std::to_string(expected) + " numbers, got '" + std::string(text) + "'");
+    return out;
+}
+
+// One character per cell, darker for more plays, attacking net on the right when folded.
+static void print_heatmap(const spatial::heatmap& map) {
+    static constexpr std::string_view shades = " .:-=+*#%@";
+    const std::uint32_t peak = std::max<std::uint32_t>(1, *std::max_element(map.begin(), map.end()));
+    for (std::size_t cy = spatial::grid_y; cy-- > 0;) {
+        std::cout << "  |";
+        for (std::size_t cx = 0; cx < spatial::grid_x; cx++) {
+            const std::uint32_t v = map[cy * spatial::grid_x + cx];
+            const std::size_t shade = v == 0 ? 0 : 1 + static_cast<std::size_t>(v) * (shades.size() - 2) / peak;
+            std::cout << shades[shade];
+        }
+        std::cout << "|\n";
+    }
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) { usage(); return 2; }
+    const std::string_view cmd = argv[1];
+
+    std::string data_dir = "../data";
+    int first_season = 0;
+    int last_season = -1;
+    std::size_t games_per_season = 1312;
+    std::size_t plays_per_game = 330;
+    query::query q;
+    std::size_t order = 0;
+    bool ordered = false;
+    bool ascending = false;
+    std::size_t limit = 0;
+    std::optional<std::int32_t> player;
+    spatial::type_mask types = spatial::all_types;
+    bool fold = false;
+    std::vector<int> rect;
+    std::vector<int> at;
+    std::size_t k = 10;
+
+    try {
+        for (int i = 2; i < argc; i++) {
+            std::string_view arg = argv[i];
+            auto next = [&]() -> std::string_view {
+                if (i + 1 >= argc) throw std::invalid_argument("missing value for " + std::string(arg));
+                return argv[++i];
+            };
+            if (arg == "--data-dir") data_dir = next();
+            else if (arg == "--seasons") {
+                // "2023" or "2013-2024"
+                std::string v(next());
+                auto dash = v.find('-');
+                first_season = std::stoi(v.substr(0, dash));
+                last_season = dash == std::string::npos ? first_season : std::stoi(v.substr(dash + 1));
+            }
+            else if (arg == "--games") games_per_season = std::stoul(std::string(next()));
+            else if (arg == "--plays") plays_per_game = std::stoul(std::string(next()));
+            else if (arg == "--where") q.where.push_back(query::parse_predicate(next()));
+            else if (arg == "--group-by") {
+                for (auto name : split(next())) {
+                    auto c = store::find_column(name);
+                    if (!c) throw std::invalid_argument("unknown column '" + std::string(name) + "'");
+                    q.group_by.push_back(*c);
+                }
+            }
+            else if (arg == "--select") {
+                for (auto a : split(next())) q.select.push_back(query::parse_aggregate(a));
+            }
+            else if (arg == "--order") { order = std::stoul(std::string(next())); ordered = true; }
+            else if (arg == "--asc") ascending = true;
+            else if (arg == "--limit") limit = std::stoul(std::string(next()));
+            else if (arg == "--player") player = std::stoi(std::string(next()));
+            else if (arg == "--types") {
+                std::vector<std::uint16_t> codes;
+                for (int c : split_ints(next(), 0)) codes.push_back(static_cast<std::uint16_t>(c));
+                types = spatial::mask_of(codes);
+            }
+            else if (arg == "--fold") fold = true;
+            else if (arg == "--rect") rect = split_ints(next(), 4);
+            else if (arg == "--at") at = split_ints(next(), 2);
+            else if (arg == "--k") k = std::stoul(std::string(next()));
+            else { usage(); return 2; }
+        }
+        if (last_season < first_season) { usage(); return 2; }
+
+        if (cmd == "synth") {
+            auto start = std::chrono::steady_clock::now();
+            const std::size_t n = static_cast<std::size_t>(last_season - first_season + 1);
+            // One error slot per season, reported once every season has had its go.
+            std::vector<std::string> errors(n);
+            hml::parallel::parallel_for(0, n, 1, [&](std::size_t lo, std::size_t hi) {
+                for (std::size_t i = lo; i < hi; i++) {
+                    const int year = first_season + static_cast<int>(i);
+                    try {
+                        std::vector<std::vector<hml::play::play_event>> games;
+                        for (std::size_t g = 0; g < games_per_season; g++) {
+                            const auto id = static_cast<std::uint32_t>(year) * 1000000u + 20001u + static_cast<std::uint32_t>(g);
+                            games.push_back(hml::play::synthetic_game(id, plays_per_game, static_cast<std::uint64_t>(year)));
+                        }
+                        store::write_season(store::season_path(data_dir, year), year, games);
+                    } catch (const std::exception& e) {
+                        errors[i] = e.what();
+                    }
+                }
+            });
+            std::size_t failed = 0;
+            for (std::size_t i = 0; i < n; i++) {
+                if (errors[i].empty()) continue;
+                std::cerr << "Season " << first_season + static_cast<int>(i) << ": " << errors[i] << "\n";
+                failed++;
+            }
+            std::cout << "Wrote " << n - failed << " seasons to " << data_dir
+                      << " in " << ms_since(start) << " ms\n";
+            return failed == 0 ? 0 : 1;
+        }
+
+        if (cmd == "ingest") {
+            auto start = std::chrono::steady_clock::now();
+            std::size_t rows = 0;
+            for (int year = first_season; year <= last_season; year++) {
+                auto games = hml::play::read_season(store::pbp_path(data_dir, year), year);
+                if (games.empty()) continue;
+                store::write_season(store::season_path(data_dir, year), year, games);
+                for (const auto& g : games) rows += g.size();
+            }
+            std::cout << "Ingested " << rows << " plays in " << ms_since(start) << " ms\n";
+            return 0;
+        }
+
+        if (cmd == "heatmap" || cmd == "region" || cmd == "near") {
+            auto start = std::chrono::steady_clock::now();
+            auto seasons = store::open_seasons(data_dir, first_season, last_season);
+            auto indexes = spatial::open_indexes(data_dir, seasons);
+            const double open_ms = ms_since(start);
+            start = std::chrono::steady_clock::now();
+
+            if (cmd == "heatmap") {
+                spatial::heatmap map(spatial::num_cells, 0);
+                for (const auto& g : indexes) {
+                    if (player) g.add_player_heatmap(*player, types, fold, map);
+                    else g.add_heatmap(types, fold, map);
+                }
+                const double query_ms = ms_since(start);
+                print_heatmap(map);
+                std::cout << std::accumulate(map.begin(), map.end(), std::uint64_t{0}) << " plays in "
+                          << spatial::grid_x << "x" << spatial::grid_y << " cells of " << spatial::cell_feet << " ft"
+                          << "  (open " << open_ms << " ms, query " << query_ms << " ms)\n";
+            } else if (cmd == "region") {
+                if (rect.empty()) { usage(); return 2; }
+                const spatial::rect r{rect[0], rect[1], rect[2], rect[3]};
+                std::size_t total = 0;
+                for (const auto& g : indexes) {
+                    const std::size_t n = g.count(r, types);
+                    std::cout << std::setw(6) << g.year() << std::setw(10) << n << "\n";
+                    total += n;
+                }
+                std::cout << total << " plays in region  (open " << open_ms << " ms, query " << ms_since(start) << " ms)\n";
+            } else {
+                if (at.empty()) { usage(); return 2; }
+                // Best k per season, then the best k overall.
+                struct hit { std::size_t season; spatial::neighbour n; };
+                std::vector<hit> hits;
+                for (std::size_t i = 0; i < indexes.size(); i++) {
+                    for (auto n : indexes[i].nearest(static_cast<float>(at[0]), static_cast<float>(at[1]), k, types)) hits.push_back({i, n});
+                }
+                std::sort(hits.begin(), hits.end(), [](const hit& a, const hit& b) { return a.n.distance < b.n.distance; });
+                if (hits.size() > k) hits.resize(k);
+                const double query_ms = ms_since(start);
+                std::cout << std::setw(12) << "game" << std::setw(8) << "event" << std::setw(6) << "type" << std::setw(10)
+                          << "player" << std::setw(6) << "x" << std::setw(6) << "y" << std::setw(10) << "distance" << "\n";
+                for (const auto& h : hits) {
+                    const auto p = seasons[h.season].row(h.n.row);
+                    std::cout << std::setw(12) << p.game_id << std::setw(8) << p.event_id << std::setw(6) << p.type_code
+                              << std::setw(10) << p.player_id << std::setw(6) << p.x << std::setw(6) << p.y
+                              << std::setw(10) << h.n.distance << "\n";
+                }
+                std::cout << hits.size() << " nearest  (open " << open_ms << " ms, query " << query_ms << " ms)\n";
+            }
+            return 0;
+        }
+
+        if (cmd != "run") { usage(); return 2; }
+        if (q.select.empty()) q.select.push_back({});
+
+        auto start = std::chrono::steady_clock::now();
+        auto seasons = store::open_seasons(data_dir, first_season, last_season);
+        const double open_ms = ms_since(start);
+
+        start = std::chrono::steady_clock::now();
+        auto r = query::run(seasons, q);
+        if (ordered || limit > 0) query::order_by(r, order, ascending, limit);
+        const double query_ms = ms_since(start);
+
+        for (auto c : r.keys) std::cout << std::setw(12) << store::info(c).name;
+        for (const auto& a : r.aggregates) std::cout << std::setw(16) << query::describe(a);
+        std::cout << "\n";
+        std::cout << std::fixed;
+        for (std::size_t g = 0; g < r.groups; g++) {
+            for (std::size_t k = 0; k < r.keys.size(); k++) std::cout << std::setw(12) << r.key_values[g * r.keys.size() + k];
+            for (std::size_t a = 0; a < r.aggregates.size(); a++) {
+                const bool whole = r.aggregates[a].fn != query::op::avg;
+                std::cout << std::setw(16) << std::setprecision(whole ? 0 : 3) << r.values[g * r.aggregates.size() + a];
+            }
+            std::cout << "\n";
+        }
+        std::cout << std::defaultfloat << std::setprecision(4)
+                  << r.groups << " groups, " << r.rows_matched << " of " << r.rows_scanned << " plays matched over "
+                  << seasons.size() << " seasons  (open " << open_ms << " ms, query " << query_ms << " ms)\n";
+    } catch (const std::exception& e) {
+        std::cerr << "PlayQuery: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
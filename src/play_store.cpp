@@ -0,0 +1,249 @@
+#include "../include/play_store.hpp"
+#include "../include/thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hml::store {
+    static std::size_t align_up(std::size_t x, std::size_t a) { return (x + a - 1) & ~(a - 1); }
+
+    template <class T>
+    static void put(std::string& out, T v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    std::optional<column> find_column(std::string_view name) {
+        for (std::size_t i = 0; i < num_columns; i++) {
+            if (columns[i].name == name) return static_cast<column>(i);
+        }
+        return std::nullopt;
+    }
+
+    std::uint8_t net_distance(const play::play_event& p) noexcept {
+        if (!(p.flags & play::has_coords)) return 255;
+        const float dx = 89.0f - static_cast<float>(std::abs(static_cast<int>(p.x)));
+        const float d = std::sqrt(dx * dx + static_cast<float>(p.y) * static_cast<float>(p.y));
+        return static_cast<std::uint8_t>(std::min(254.0f, std::round(d)));
+    }
+
+    std::string pbp_path(const std::string& dir, int year) {
+        return dir + "/" + std::to_string(year) + "_" + std::to_string(year + 1) + "_pbp.bin";
+    }
+
+    std::string season_path(const std::string& dir, int year) {
+        return dir + "/" + std::to_string(year) + "_" + std::to_string(year + 1) + "_plays.col";
+    }
+
+    // Value of column c for play p, as stored.
+    static std::int64_t field(const play::play_event& p, column c) {
+        switch (c) {
+            case column::game: return p.game_id;
+            case column::event: return p.event_id;
+            case column::team: return p.team_id;
+            case column::player: return p.player_id;
+            case column::type: return p.type_code;
+            case column::seconds: return p.seconds;
+            case column::x: return p.x;
+            case column::y: return p.y;
+            case column::situation: return p.situation;
+            case column::period: return p.period;
+            case column::zone: return static_cast<std::uint8_t>(p.zone_code);
+            case column::home_score: return p.home_score;
+            case column::away_score: return p.away_score;
+            case column::flags: return p.flags;
+            case column::net_dist: return net_distance(p);
+            case column::season: break;
+        }
+        return 0;
+    }
+
+    void write_season(const std::string& path, int year, const std::vector<std::vector<play::play_event>>& games) {
+        std::size_t rows = 0;
+        for (const auto& g : games) rows += g.size();
+        const std::size_t padded = align_up(rows, row_block);
+        const std::size_t stored = num_columns - 1;
+
+        std::string header;
+        header.append(magic, sizeof(magic));
+        put<std::uint32_t>(header, version);
+        put<std::uint32_t>(header, static_cast<std::uint32_t>(year));
+        put<std::uint64_t>(header, rows);
+        put<std::uint64_t>(header, padded);
+        put<std::uint32_t>(header, static_cast<std::uint32_t>(stored));
+        put<std::uint32_t>(header, 0);
+
+        std::size_t offset = align_up(header.size() + stored * 16, alignment);
+        std::vector<std::size_t> offsets(stored);
+        for (std::size_t c = 0; c < stored; c++) {
+            offsets[c] = offset;
+            put<std::uint8_t>(header, static_cast<std::uint8_t>(c));
+            put<std::uint8_t>(header, columns[c].width);
+            put<std::uint16_t>(header, 0);
+            put<std::uint32_t>(header, 0);
+            put<std::uint64_t>(header, offset);
+            offset = align_up(offset + padded * columns[c].width, alignment);
+        }
+
+        // Readers map column files, and two processes may rebuild the same stale
+        // season at once, so each writer fills its own temporary file and renames
+        // it into place: readers see the old file or the new one, never a torn one.
+        const std::string tmp = path + ".tmp." + std::to_string(::getpid());
+        std::ofstream outfile(tmp, std::ios::binary | std::ios::trunc);
+        if (!outfile) throw std::runtime_error("store: cannot open " + tmp);
+        outfile.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+        static const char zeros[alignment] = {};
+        std::size_t pos = header.size();
+        std::vector<char> buffer;
+        for (std::size_t c = 0; c < stored; c++) {
+            const std::size_t width = columns[c].width;
+            buffer.assign(padded * width, 0);
+            std::size_t r = 0;
+            for (const auto& g : games) {
+                for (const auto& p : g) {
+                    // Little endian: the low `width` bytes hold the value for any signedness.
+                    const std::int64_t v = field(p, static_cast<column>(c));
+                    std::memcpy(buffer.data() + r * width, &v, width);
+                    r++;
+                }
+            }
+            outfile.write(zeros, static_cast<std::streamsize>(offsets[c] - pos));
+            outfile.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            pos = offsets[c] + buffer.size();
+        }
+        outfile.close();
+        if (!outfile || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("store: write failed for " + path);
+        }
+    }
+
+    namespace {
+        struct reader {
+            const unsigned char* p;
+            const unsigned char* end;
+
+            template <class T>
+            T get() {
+                if (static_cast<std::size_t>(end - p) < sizeof(T)) throw std::runtime_error("store: truncated header");
+                T v;
+                std::memcpy(&v, p, sizeof(T));
+                p += sizeof(T);
+                return v;
+            }
+        };
+    }
+
+    season season::open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("store: cannot open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(magic))) {
+            ::close(fd);
+            throw std::runtime_error("store: not a column file " + path);
+        }
+        const std::size_t file_size = static_cast<std::size_t>(st.st_size);
+        void* base = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) throw std::runtime_error("store: mmap failed for " + path);
+
+        season s;
+        s.mapping_ = std::shared_ptr<const void>(base, [file_size](const void* p) { ::munmap(const_cast<void*>(p), file_size); });
+
+        const auto* bytes = static_cast<const unsigned char*>(base);
+        reader r{bytes, bytes + file_size};
+        if (std::memcmp(r.p, magic, sizeof(magic)) != 0) throw std::runtime_error("store: bad magic in " + path);
+        r.p += sizeof(magic);
+        if (r.get<std::uint32_t>() != version) throw std::runtime_error("store: unsupported version in " + path);
+        s.year_ = static_cast<int>(r.get<std::uint32_t>());
+        s.rows_ = static_cast<std::size_t>(r.get<std::uint64_t>());
+        s.padded_rows_ = static_cast<std::size_t>(r.get<std::uint64_t>());
+        const std::uint32_t count = r.get<std::uint32_t>();
+        (void)r.get<std::uint32_t>();
+        if (s.padded_rows_ % row_block != 0 || s.rows_ > s.padded_rows_)
+            throw std::runtime_error("store: corrupt row count in " + path);
+
+        for (std::uint32_t i = 0; i < count; i++) {
+            const std::uint8_t id = r.get<std::uint8_t>();
+            const std::uint8_t width = r.get<std::uint8_t>();
+            (void)r.get<std::uint16_t>();
+            (void)r.get<std::uint32_t>();
+            const std::size_t offset = static_cast<std::size_t>(r.get<std::uint64_t>());
+            if (id >= num_columns - 1 || width != columns[id].width || offset % alignment != 0 || offset > file_size
+                || s.padded_rows_ * width > file_size - offset)
+                throw std::runtime_error("store: corrupt column entry in " + path);
+            s.data_[id] = bytes + offset;
+        }
+        for (std::size_t c = 0; c + 1 < num_columns; c++) {
+            if (s.data_[c] == nullptr) throw std::runtime_error("store: missing column " + std::string(columns[c].name) + " in " + path);
+        }
+        return s;
+    }
+
+    play::play_event season::row(std::size_t r) const {
+        play::play_event p;
+        p.game_id = get<std::uint32_t>(column::game)[r];
+        p.event_id = get<std::int32_t>(column::event)[r];
+        p.team_id = get<std::int32_t>(column::team)[r];
+        p.player_id = get<std::int32_t>(column::player)[r];
+        p.type_code = get<std::uint16_t>(column::type)[r];
+        p.seconds = get<std::uint16_t>(column::seconds)[r];
+        p.x = get<std::int16_t>(column::x)[r];
+        p.y = get<std::int16_t>(column::y)[r];
+        p.situation = get<std::uint16_t>(column::situation)[r];
+        p.period = get<std::uint8_t>(column::period)[r];
+        p.zone_code = static_cast<play::zone>(get<std::uint8_t>(column::zone)[r]);
+        p.home_score = get<std::uint8_t>(column::home_score)[r];
+        p.away_score = get<std::uint8_t>(column::away_score)[r];
+        p.flags = get<std::uint8_t>(column::flags)[r];
+        return p;
+    }
+
+    std::vector<season> open_seasons(const std::string& dir, int first, int last) {
+        namespace fs = std::filesystem;
+        if (last < first) return {};
+        const std::size_t n = static_cast<std::size_t>(last - first + 1);
+        std::vector<std::optional<season>> opened(n);
+        std::mutex log_mutex;
+
+        parallel::parallel_for(0, n, 1, [&](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = lo; i < hi; i++) {
+                const int year = first + static_cast<int>(i);
+                const std::string col = season_path(dir, year);
+                const std::string pbp = pbp_path(dir, year);
+                std::error_code ec;
+                const bool have_col = fs::exists(col, ec);
+                const bool have_pbp = fs::exists(pbp, ec);
+                try {
+                    if (have_pbp && (!have_col || fs::last_write_time(col, ec) < fs::last_write_time(pbp, ec))) {
+                        write_season(col, year, play::read_season(pbp, year));
+                    } else if (!have_col) {
+                        std::lock_guard<std::mutex> lock(log_mutex);
+                        std::cerr << "No data for season " << year << " in " << dir << "\n";
+                        continue;
+                    }
+                    opened[i] = season::open(col);
+                } catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(log_mutex);
+                    std::cerr << "Skipping season " << year << ": " << e.what() << "\n";
+                }
+            }
+        });
+
+        std::vector<season> out;
+        for (auto& s : opened) {
+            if (s) out.push_back(std::move(*s));
+        }
+        return out;
+    }
+}
@@ -0,0 +1,504 @@
+#include "../include/query.hpp"
+#include "../include/thread_pool.hpp"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace hml::query {
+    namespace detail {
+        template <class T>
+        void match_range_scalar(const T* values, std::size_t n, T lo, T hi, std::uint64_t* bits) {
+            for (std::size_t w = 0; w < n / 64; w++) {
+                const T* v = values + w * 64;
+                std::uint64_t m = 0;
+                for (std::size_t j = 0; j < 64; j++) {
+                    m |= static_cast<std::uint64_t>(v[j] >= lo && v[j] <= hi) << j;
+                }
+                bits[w] = m;
+            }
+        }
+    }
+
+#if defined(__AVX2__)
+    // Signed compares only: unsigned values are shifted into signed range by
+    // flipping the top bit of both the values and the bounds.
+    template <class T>
+    static __m256i bias() {
+        if constexpr (std::is_signed_v<T>) return _mm256_setzero_si256();
+        else if constexpr (sizeof(T) == 1) return _mm256_set1_epi8(static_cast<char>(0x80));
+        else if constexpr (sizeof(T) == 2) return _mm256_set1_epi16(static_cast<short>(0x8000));
+        else return _mm256_set1_epi32(static_cast<int>(0x80000000u));
+    }
+
+    template <class T>
+    static __m256i splat(T v) {
+        if constexpr (sizeof(T) == 1) return _mm256_xor_si256(_mm256_set1_epi8(static_cast<char>(v)), bias<T>());
+        else if constexpr (sizeof(T) == 2) return _mm256_xor_si256(_mm256_set1_epi16(static_cast<short>(v)), bias<T>());
+        else return _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(v)), bias<T>());
+    }
+
+    template <class T>
+    static __m256i outside(__m256i v, __m256i lo, __m256i hi) {
+        v = _mm256_xor_si256(v, bias<T>());
+        if constexpr (sizeof(T) == 1) return _mm256_or_si256(_mm256_cmpgt_epi8(lo, v), _mm256_cmpgt_epi8(v, hi));
+        else if constexpr (sizeof(T) == 2) return _mm256_or_si256(_mm256_cmpgt_epi16(lo, v), _mm256_cmpgt_epi16(v, hi));
+        else return _mm256_or_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(v, hi));
+    }
+
+    // 32 rows -> 32 bits.
+    template <class T>
+    static std::uint32_t match32(const T* v, __m256i lo, __m256i hi) {
+        auto load = [](const T* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); };
+        if constexpr (sizeof(T) == 1) {
+            return ~static_cast<std::uint32_t>(_mm256_movemask_epi8(outside<T>(load(v), lo, hi)));
+        } else if constexpr (sizeof(T) == 2) {
+            // packs interleaves 128-bit lanes (a0-7 b0-7 a8-15 b8-15); the permute restores row order.
+            __m256i packed = _mm256_packs_epi16(outside<T>(load(v), lo, hi), outside<T>(load(v + 16), lo, hi));
+            packed = _mm256_permute4x64_epi64(packed, 0xD8);
+            return ~static_cast<std::uint32_t>(_mm256_movemask_epi8(packed));
+        } else {
+            std::uint32_t m = 0;
+            for (int k = 0; k < 4; k++) {
+                const __m256 out = _mm256_castsi256_ps(outside<T>(load(v + 8 * k), lo, hi));
+                m |= static_cast<std::uint32_t>(_mm256_movemask_ps(out)) << (8 * k);
+            }
+            return ~m;
+        }
+    }
+#endif
+
+    template <class T>
+    void match_range(const T* values, std::size_t n, T lo, T hi, std::uint64_t* bits) {
+#if defined(__AVX2__)
+        const __m256i vlo = splat(lo);
+        const __m256i vhi = splat(hi);
+        for (std::size_t w = 0; w < n / 64; w++) {
+            const T* v = values + w * 64;
+            bits[w] = static_cast<std::uint64_t>(match32(v, vlo, vhi))
+                    | static_cast<std::uint64_t>(match32(v + 32, vlo, vhi)) << 32;
+        }
+#else
+        detail::match_range_scalar(values, n, lo, hi, bits);
+#endif
+    }
+
+#define HML_QUERY_INSTANTIATE(T)                                                                   \
+    template void match_range<T>(const T*, std::size_t, T, T, std::uint64_t*);                     \
+    template void detail::match_range_scalar<T>(const T*, std::size_t, T, T, std::uint64_t*);
+    HML_QUERY_INSTANTIATE(std::int8_t)
+    HML_QUERY_INSTANTIATE(std::uint8_t)
+    HML_QUERY_INSTANTIATE(std::int16_t)
+    HML_QUERY_INSTANTIATE(std::uint16_t)
+    HML_QUERY_INSTANTIATE(std::int32_t)
+    HML_QUERY_INSTANTIATE(std::uint32_t)
+#undef HML_QUERY_INSTANTIATE
+
+    namespace {
+        constexpr std::size_t block_rows = std::size_t{1} << 16;
+        constexpr std::size_t block_words = block_rows / 64;
+
+        // Calls fn(const T*) with the column's stored type.
+        template <class Fn>
+        void with_column(const store::season& s, store::column c, Fn&& fn) {
+            const auto& ci = store::info(c);
+            switch (ci.width) {
+                case 1: return ci.is_signed ? fn(s.get<std::int8_t>(c)) : fn(s.get<std::uint8_t>(c));
+                case 2: return ci.is_signed ? fn(s.get<std::int16_t>(c)) : fn(s.get<std::uint16_t>(c));
+                case 4: return ci.is_signed ? fn(s.get<std::int32_t>(c)) : fn(s.get<std::uint32_t>(c));
+            }
+            throw std::invalid_argument("query: column " + std::string(ci.name) + " is not stored");
+        }
+
+        bool in_ranges(std::int64_t v, const predicate& p) {
+            bool hit = false;
+            for (auto [lo, hi] : p.ranges) hit |= v >= lo && v <= hi;
+            return hit != p.negate;
+        }
+
+        // ANDs the predicate over rows [begin, begin + 64 * words) into bits.
+        void apply(const store::season& s, const predicate& p, std::size_t begin, std::size_t words,
+                   std::uint64_t* bits, std::uint64_t* scratch, std::uint64_t* hits) {
+            std::fill(hits, hits + words, 0);
+            with_column(s, p.col, [&](const auto* col) {
+                using T = std::remove_cvref_t<decltype(*col)>;
+                constexpr std::int64_t tmin = std::numeric_limits<T>::min();
+                constexpr std::int64_t tmax = std::numeric_limits<T>::max();
+                for (auto [lo, hi] : p.ranges) {
+                    lo = std::max(lo, tmin);
+                    hi = std::min(hi, tmax);
+                    if (lo > hi) continue;
+                    match_range<T>(col + begin, words * 64, static_cast<T>(lo), static_cast<T>(hi), scratch);
+                    for (std::size_t w = 0; w < words; w++) hits[w] |= scratch[w];
+                }
+            });
+            if (p.negate) {
+                for (std::size_t w = 0; w < words; w++) bits[w] &= ~hits[w];
+            } else {
+                for (std::size_t w = 0; w < words; w++) bits[w] &= hits[w];
+            }
+        }
+
+        using key = std::array<std::uint32_t, max_group_columns>;
+
+        // Groups are numbered densely in insertion order; an open addressing
+        // index (linear probing) maps keys to group ids, so ids stay valid
+        // across rehashes. Each group owns `width` int64 accumulators: the row
+        // count, then one per aggregate.
+        class group_table {
+            public:
+                group_table(std::size_t num_keys, const std::vector<aggregate>& aggs)
+                    : num_keys_(num_keys), width_(aggs.size() + 1), init_(width_, 0), index_(64, 0) {
+                    for (std::size_t a = 0; a < aggs.size(); a++) {
+                        if (aggs[a].fn == op::min) init_[a + 1] = std::numeric_limits<std::int64_t>::max();
+                        if (aggs[a].fn == op::max) init_[a + 1] = std::numeric_limits<std::int64_t>::min();
+                    }
+                }
+
+                std::size_t size() const noexcept { return keys_.size(); }
+                const key& key_at(std::size_t group) const noexcept { return keys_[group]; }
+                std::int64_t* acc(std::size_t group) noexcept { return state_.data() + group * width_; }
+
+                std::size_t find_or_insert(const key& k) {
+                    if ((size() + 1) * 4 > index_.size() * 3) grow();
+                    const std::size_t mask = index_.size() - 1;
+                    for (std::size_t slot = hash(k) & mask;; slot = (slot + 1) & mask) {
+                        const std::uint32_t id = index_[slot];
+                        if (id == 0) {
+                            keys_.push_back(k);
+                            state_.insert(state_.end(), init_.begin(), init_.end());
+                            index_[slot] = static_cast<std::uint32_t>(keys_.size());
+                            return keys_.size() - 1;
+                        }
+                        if (keys_[id - 1] == k) return id - 1;
+                    }
+                }
+
+            private:
+                std::size_t hash(const key& k) const noexcept {
+                    std::uint64_t h = 0x9e3779b97f4a7c15ull;
+                    for (std::size_t i = 0; i < num_keys_; i++) {
+                        h = (h ^ k[i]) * 0xff51afd7ed558ccdull;
+                        h ^= h >> 32;
+                    }
+                    return static_cast<std::size_t>(h);
+                }
+
+                void grow() {
+                    index_.assign(index_.size() * 2, 0);
+                    const std::size_t mask = index_.size() - 1;
+                    for (std::size_t g = 0; g < keys_.size(); g++) {
+                        std::size_t slot = hash(keys_[g]) & mask;
+                        while (index_[slot] != 0) slot = (slot + 1) & mask;
+                        index_[slot] = static_cast<std::uint32_t>(g + 1);
+                    }
+                }
+
+                std::size_t num_keys_;
+                std::size_t width_;
+                std::vector<std::int64_t> init_;
+                std::vector<std::uint32_t> index_;   // group id + 1, 0 for empty
+                std::vector<key> keys_;
+                std::vector<std::int64_t> state_;
+        };
+
+        void fold(std::int64_t* into, const std::int64_t* from, const std::vector<aggregate>& aggs) {
+            into[0] += from[0];
+            for (std::size_t a = 0; a < aggs.size(); a++) {
+                std::int64_t& dst = into[a + 1];
+                const std::int64_t src = from[a + 1];
+                switch (aggs[a].fn) {
+                    case op::min: dst = std::min(dst, src); break;
+                    case op::max: dst = std::max(dst, src); break;
+                    default: dst += src; break;
+                }
+            }
+        }
+
+        struct block {
+            std::size_t season;
+            std::size_t begin;
+            std::size_t end;
+        };
+
+        // Per-task buffers, reused across the blocks a task scans.
+        struct scan_state {
+            std::vector<std::uint64_t> bits, scratch, hits;
+            std::vector<std::uint32_t> rows, slots;
+            std::vector<std::int64_t> values;
+            std::array<std::vector<std::uint32_t>, max_group_columns> keys;
+            group_table table;
+            std::size_t scanned = 0;
+            std::size_t matched = 0;
+
+            scan_state(const query& q) : bits(block_words), scratch(block_words), hits(block_words),
+                                         table(q.group_by.size(), q.select) {}
+        };
+
+        void scan(const store::season& s, const block& b, const query& q, scan_state& st) {
+            const std::size_t words = (b.end - b.begin) / 64;
+            std::fill(st.bits.begin(), st.bits.begin() + words, ~std::uint64_t{0});
+            // Padding rows past rows() never match.
+            for (std::size_t w = 0; w < words; w++) {
+                const std::size_t first = b.begin + w * 64;
+                if (first >= s.rows()) st.bits[w] = 0;
+                else if (first + 64 > s.rows()) st.bits[w] = (std::uint64_t{1} << (s.rows() - first)) - 1;
+            }
+            for (const auto& p : q.where) {
+                if (p.col == store::column::season) continue;
+                apply(s, p, b.begin, words, st.bits.data(), st.scratch.data(), st.hits.data());
+            }
+
+            st.rows.clear();
+            for (std::size_t w = 0; w < words; w++) {
+                for (std::uint64_t m = st.bits[w]; m; m &= m - 1) {
+                    st.rows.push_back(static_cast<std::uint32_t>(b.begin + w * 64 + std::countr_zero(m)));
+                }
+            }
+            const std::size_t n = st.rows.size();
+            st.scanned += std::min(b.end, s.rows()) - std::min(b.begin, s.rows());
+            st.matched += n;
+            if (n == 0) return;
+
+            // Gather key columns for the selected rows, then hash each row once.
+            const std::size_t nkeys = q.group_by.size();
+            for (std::size_t k = 0; k < nkeys; k++) {
+                auto& out = st.keys[k];
+                out.resize(n);
+                if (q.group_by[k] == store::column::season) {
+                    std::fill(out.begin(), out.end(), static_cast<std::uint32_t>(s.year()));
+                    continue;
+                }
+                with_column(s, q.group_by[k], [&](const auto* col) {
+                    for (std::size_t i = 0; i < n; i++) out[i] = static_cast<std::uint32_t>(col[st.rows[i]]);
+                });
+            }
+            st.slots.resize(n);
+            key k{};
+            for (std::size_t i = 0; i < n; i++) {
+                for (std::size_t j = 0; j < nkeys; j++) k[j] = st.keys[j][i];
+                st.slots[i] = static_cast<std::uint32_t>(st.table.find_or_insert(k));
+            }
+            for (std::size_t i = 0; i < n; i++) st.table.acc(st.slots[i])[0]++;
+            for (std::size_t a = 0; a < q.select.size(); a++) {
+                const aggregate& agg = q.select[a];
+                if (agg.fn == op::count) continue;
+                st.values.resize(n);
+                if (agg.col == store::column::season) {
+                    std::fill(st.values.begin(), st.values.end(), s.year());
+                } else {
+                    with_column(s, agg.col, [&](const auto* col) {
+                        for (std::size_t i = 0; i < n; i++) st.values[i] = col[st.rows[i]];
+                    });
+                }
+                for (std::size_t i = 0; i < n; i++) {
+                    std::int64_t& dst = st.table.acc(st.slots[i])[a + 1];
+                    switch (agg.fn) {
+                        case op::min: dst = std::min(dst, st.values[i]); break;
+                        case op::max: dst = std::max(dst, st.values[i]); break;
+                        default: dst += st.values[i]; break;
+                    }
+                }
+            }
+        }
+
+        std::int64_t key_value(store::column c, std::uint32_t raw) {
+            const auto& ci = store::info(c);
+            if (!ci.is_signed) return raw;
+            if (ci.width == 1) return static_cast<std::int8_t>(raw);
+            if (ci.width == 2) return static_cast<std::int16_t>(raw);
+            return static_cast<std::int32_t>(raw);
+        }
+    }
+
+    result run(const std::vector<store::season>& seasons, const query& q) {
+        if (q.group_by.size() > max_group_columns)
+            throw std::invalid_argument("query: at most " + std::to_string(max_group_columns) + " group-by columns");
+
+        // Season predicates are decided per file, so whole seasons drop out before any scan.
+        std::vector<block> blocks;
+        for (std::size_t i = 0; i < seasons.size(); i++) {
+            bool keep = true;
+            for (const auto& p : q.where) {
+                if (p.col == store::column::season) keep &= in_ranges(seasons[i].year(), p);
+            }
+            if (!keep) continue;
+            for (std::size_t r = 0; r < seasons[i].padded_rows(); r += block_rows) {
+                blocks.push_back({i, r, std::min(r + block_rows, seasons[i].padded_rows())});
+            }
+        }
+
+        std::mutex merge_mutex;
+        group_table merged(q.group_by.size(), q.select);
+        result out;
+        out.keys = q.group_by;
+        out.aggregates = q.select;
+
+        parallel::parallel_for(0, blocks.size(), 1, [&](std::size_t lo, std::size_t hi) {
+            scan_state st(q);
+            for (std::size_t b = lo; b < hi; b++) scan(seasons[blocks[b].season], blocks[b], q, st);
+
+            std::lock_guard<std::mutex> lock(merge_mutex);
+            out.rows_scanned += st.scanned;
+            out.rows_matched += st.matched;
+            for (std::size_t g = 0; g < st.table.size(); g++) {
+                const std::size_t dst = merged.find_or_insert(st.table.key_at(g));
+                fold(merged.acc(dst), st.table.acc(g), q.select);
+            }
+        });
+
+        std::vector<std::size_t> slots(merged.size());
+        std::iota(slots.begin(), slots.end(), 0);
+        const std::size_t nkeys = q.group_by.size();
+        auto key_of = [&](std::size_t slot, std::size_t j) { return key_value(q.group_by[j], merged.key_at(slot)[j]); };
+        std::sort(slots.begin(), slots.end(), [&](std::size_t a, std::size_t b) {
+            for (std::size_t j = 0; j < nkeys; j++) {
+                const std::int64_t ka = key_of(a, j), kb = key_of(b, j);
+                if (ka != kb) return ka < kb;
+            }
+            return false;
+        });
+
+        out.groups = slots.size();
+        out.key_values.reserve(slots.size() * nkeys);
+        out.values.reserve(slots.size() * q.select.size());
+        for (std::size_t slot : slots) {
+            for (std::size_t j = 0; j < nkeys; j++) out.key_values.push_back(key_of(slot, j));
+            const std::int64_t* acc = merged.acc(slot);
+            for (std::size_t a = 0; a < q.select.size(); a++) {
+                switch (q.select[a].fn) {
+                    case op::count: out.values.push_back(static_cast<double>(acc[0])); break;
+                    case op::avg: out.values.push_back(static_cast<double>(acc[a + 1]) / static_cast<double>(acc[0])); break;
+                    default: out.values.push_back(static_cast<double>(acc[a + 1])); break;
+                }
+            }
+        }
+        return out;
+    }
+
+    void order_by(result& r, std::size_t index, bool ascending, std::size_t limit) {
+        const std::size_t nk = r.keys.size();
+        const std::size_t na = r.aggregates.size();
+        if (index >= na) throw std::invalid_argument("query: no aggregate " + std::to_string(index) + " to order by");
+
+        std::vector<std::size_t> order(r.groups);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+            const double va = r.values[a * na + index], vb = r.values[b * na + index];
+            return ascending ? va < vb : va > vb;
+        });
+        if (limit > 0 && order.size() > limit) order.resize(limit);
+
+        std::vector<std::int64_t> keys;
+        std::vector<double> values;
+        keys.reserve(order.size() * nk);
+        values.reserve(order.size() * na);
+        for (std::size_t g : order) {
+            keys.insert(keys.end(), r.key_values.begin() + g * nk, r.key_values.begin() + (g + 1) * nk);
+            values.insert(values.end(), r.values.begin() + g * na, r.values.begin() + (g + 1) * na);
+        }
+        r.groups = order.size();
+        r.key_values = std::move(keys);
+        r.values = std::move(values);
+    }
+
+    static store::column parse_column(std::string_view name) {
+        auto c = store::find_column(name);
+        if (!c) throw std::invalid_argument("query: unknown column '" + std::string(name) + "'");
+        return *c;
+    }
+
+    static std::int64_t parse_int(std::string_view text) {
+        std::int64_t v = 0;
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), v);
+        if (ec != std::errc{} || end != text.data() + text.size() || text.empty())
+            throw std::invalid_argument("query: bad number '" + std::string(text) + "'");
+        return v;
+    }
+
+    predicate parse_predicate(std::string_view text) {
+        constexpr std::int64_t lowest = std::numeric_limits<std::int64_t>::min();
+        constexpr std::int64_t highest = std::numeric_limits<std::int64_t>::max();
+
+        const std::size_t at = text.find_first_of("<>!=");
+        if (at == std::string_view::npos || at == 0) throw std::invalid_argument("query: bad predicate '" + std::string(text) + "'");
+        predicate p;
+        p.col = parse_column(text.substr(0, at));
+
+        std::string_view rest = text.substr(at);
+        std::string_view op;
+        for (std::string_view candidate : {"<=", ">=", "!=", "=", "<", ">"}) {
+            if (rest.starts_with(candidate)) {
+                op = candidate;
+                break;
+            }
+        }
+        if (op.empty()) throw std::invalid_argument("query: bad predicate '" + std::string(text) + "'");
+        rest.remove_prefix(op.size());
+
+        // Strict bounds at the ends of int64 match nothing: no ranges at all.
+        if (op == "<") {
+            const std::int64_t v = parse_int(rest);
+            if (v != lowest) p.ranges.emplace_back(lowest, v - 1);
+        } else if (op == "<=") p.ranges.emplace_back(lowest, parse_int(rest));
+        else if (op == ">") {
+            const std::int64_t v = parse_int(rest);
+            if (v != highest) p.ranges.emplace_back(v + 1, highest);
+        }
+        else if (op == ">=") p.ranges.emplace_back(parse_int(rest), highest);
+        else {
+            // "=a,b,c..d" / "!=a,b,c..d"
+            p.negate = op == "!=";
+            while (true) {
+                const std::size_t comma = rest.find(',');
+                const std::string_view item = rest.substr(0, comma);
+                const std::size_t dots = item.find("..");
+                if (dots == std::string_view::npos) {
+                    const std::int64_t v = parse_int(item);
+                    p.ranges.emplace_back(v, v);
+                } else {
+                    p.ranges.emplace_back(parse_int(item.substr(0, dots)), parse_int(item.substr(dots + 2)));
+                }
+                if (comma == std::string_view::npos) break;
+                rest.remove_prefix(comma + 1);
+            }
+        }
+        return p;
+    }
+
+    aggregate parse_aggregate(std::string_view text) {
+        static constexpr std::pair<std::string_view, op> names[] = {
+            {"count", op::count}, {"sum", op::sum}, {"avg", op::avg}, {"min", op::min}, {"max", op::max},
+        };
+        const std::size_t colon = text.find(':');
+        const std::string_view fn = text.substr(0, colon);
+        for (auto [name, o] : names) {
+            if (name != fn) continue;
+            aggregate a;
+            a.fn = o;
+            if (o == op::count) {
+                if (colon != std::string_view::npos) throw std::invalid_argument("query: count takes no column");
+                return a;
+            }
+            if (colon == std::string_view::npos) throw std::invalid_argument("query: " + std::string(fn) + " needs a column, e.g. " + std::string(fn) + ":seconds");
+            a.col = parse_column(text.substr(colon + 1));
+            return a;
+        }
+        throw std::invalid_argument("query: unknown aggregate '" + std::string(text) + "'");
+    }
+
+    std::string describe(const aggregate& a) {
+        static constexpr std::string_view names[] = {"count", "sum", "avg", "min", "max"};
+        std::string out(names[static_cast<std::size_t>(a.fn)]);
+        if (a.fn != op::count) out += "(" + std::string(store::info(a.col).name) + ")";
+        return out;
+    }
+}
@@ -0,0 +1,249 @@
+// query_test.cpp
+// Tests for the season column files and the query engine: vector filters
+// against the scalar reference, file round trips and group-by results
+// against a straightforward loop over the plays.
+
+#include "../include/play_store.hpp"
+#include "../include/query.hpp"
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <cassert>
+#include <cstdio>
+
+using namespace std;
+namespace store = hml::store;
+namespace query = hml::query;
+using hml::play::play_event;
+
+template <class T>
+static void check_match_range(mt19937& rng) {
+    const size_t n = 64 * 37;
+    vector<T> values(n);
+    uniform_int_distribution<long long> any(numeric_limits<T>::min(), numeric_limits<T>::max());
+    for (auto& v : values) v = static_cast<T>(any(rng));
+    // A few values sitting right on the bounds.
+    values[0] = numeric_limits<T>::min();
+    values[1] = numeric_limits<T>::max();
+
+    vector<uint64_t> fast(n / 64), slow(n / 64);
+    for (int trial = 0; trial < 50; trial++) {
+        T lo = static_cast<T>(any(rng));
+        T hi = static_cast<T>(any(rng));
+        if (lo > hi) swap(lo, hi);
+        if (trial == 0) { lo = numeric_limits<T>::min(); hi = numeric_limits<T>::max(); }
+        if (trial == 1) { lo = hi = values[5]; }
+        query::match_range<T>(values.data(), n, lo, hi, fast.data());
+        query::detail::match_range_scalar<T>(values.data(), n, lo, hi, slow.data());
+        assert(fast == slow && "match_range disagrees with the scalar reference");
+    }
+    if constexpr (sizeof(T) < 4) {
+        query::match_range<T>(values.data(), n, numeric_limits<T>::min(), numeric_limits<T>::max(), fast.data());
+        for (auto w : fast) assert(w == ~uint64_t{0});
+    }
+}
+
+static void test_match_range() {
+    cout << "=== test_match_range ===\n";
+
+    mt19937 rng(7);
+    check_match_range<int8_t>(rng);
+    check_match_range<uint8_t>(rng);
+    check_match_range<int16_t>(rng);
+    check_match_range<uint16_t>(rng);
+    check_match_range<int32_t>(rng);
+    check_match_range<uint32_t>(rng);
+
+    cout << "OK\n\n";
+}
+
+static vector<vector<play_event>> season_games(int year, size_t games) {
+    vector<vector<play_event>> out;
+    for (size_t g = 0; g < games; g++) {
+        const auto id = static_cast<uint32_t>(year) * 1000000u + 20001u + static_cast<uint32_t>(g);
+        out.push_back(hml::play::synthetic_game(id, 100 + (g * 37) % 300, static_cast<uint64_t>(year)));
+    }
+    return out;
+}
+
+static void test_season_roundtrip() {
+    cout << "=== test_season_roundtrip ===\n";
+
+    auto games = season_games(2019, 7);
+    games[3][10].flags = 0; // no coordinates
+    const string path = store::season_path(".", 2019);
+    store::write_season(path, 2019, games);
+
+    {
+        auto s = store::season::open(path);
+        size_t rows = 0;
+        for (const auto& g : games) rows += g.size();
+        assert(s.year() == 2019);
+        assert(s.rows() == rows);
+        assert(s.padded_rows() % 64 == 0 && s.padded_rows() >= rows && s.padded_rows() < rows + 64);
+        assert(s.data(store::column::season) == nullptr);
+
+        size_t r = 0;
+        for (const auto& g : games) {
+            for (const auto& p : g) {
+                play_event q = s.row(r);
+                assert(q.game_id == p.game_id && q.event_id == p.event_id && q.team_id == p.team_id);
+                assert(q.player_id == p.player_id && q.type_code == p.type_code && q.seconds == p.seconds);
+                assert(q.x == p.x && q.y == p.y && q.situation == p.situation && q.period == p.period);
+                assert(q.zone_code == p.zone_code && q.home_score == p.home_score && q.away_score == p.away_score);
+                assert(q.flags == p.flags);
+                assert(s.get<uint8_t>(store::column::net_dist)[r] == store::net_distance(p));
+                r++;
+            }
+        }
+        for (; r < s.padded_rows(); r++) assert(s.get<uint32_t>(store::column::game)[r] == 0);
+
+        // Rewriting a season that is still open leaves the open mapping intact.
+        const size_t rows_before = s.rows();
+        store::write_season(path, 2019, {games[0]});
+        assert(s.rows() == rows_before);
+        assert(s.row(rows_before - 1).event_id == games.back().back().event_id);
+        assert(store::season::open(path).rows() == games[0].size());
+    }
+
+    play_event at_net;
+    at_net.flags = hml::play::has_coords;
+    at_net.x = -89;
+    assert(store::net_distance(at_net) == 0);
+    at_net.x = 79;
+    at_net.y = 0;
+    assert(store::net_distance(at_net) == 10);
+    at_net.flags = 0;
+    assert(store::net_distance(at_net) == 255);
+
+    std::remove(path.c_str());
+    cout << "OK\n\n";
+}
+
+static void test_group_by_matches_naive() {
+    cout << "=== test_group_by_matches_naive ===\n";
+
+    // Enough rows that seasons span several scan blocks.
+    vector<int> years{2015, 2016, 2017};
+    map<int, vector<vector<play_event>>> by_year;
+    vector<store::season> seasons;
+    for (int year : years) {
+        by_year[year] = season_games(year, year == 2016 ? 400 : 60);
+        store::write_season(store::season_path(".", year), year, by_year[year]);
+        seasons.push_back(store::season::open(store::season_path(".", year)));
+    }
+
+    query::query q;
+    q.where.push_back(query::parse_predicate("type=505,506..508"));
+    q.where.push_back(query::parse_predicate("net_dist<=40"));
+    q.where.push_back(query::parse_predicate("period!=3"));
+    q.where.push_back(query::parse_predicate("season>=2016"));
+    q.group_by = {store::column::season, store::column::team, store::column::type};
+    for (const char* a : {"count", "sum:seconds", "avg:net_dist", "min:x", "max:y"}) {
+        q.select.push_back(query::parse_aggregate(a));
+    }
+    auto r = query::run(seasons, q);
+
+    struct acc { long long count = 0, seconds = 0, dist = 0, min_x = 1 << 20, max_y = -(1 << 20); };
+    map<tuple<long long, long long, long long>, acc> want;
+    size_t total = 0, matched = 0;
+    for (int year : years) {
+        for (const auto& g : by_year[year]) {
+            for (const auto& p : g) {
+                total++;
+                const int dist = store::net_distance(p);
+                const bool type_ok = p.type_code == 505 || (p.type_code >= 506 && p.type_code <= 508);
+                if (year < 2016 || !type_ok || dist > 40 || p.period == 3) continue;
+                matched++;
+                auto& a = want[{year, p.team_id, p.type_code}];
+                a.count++;
+                a.seconds += p.seconds;
+                a.dist += dist;
+                a.min_x = min<long long>(a.min_x, p.x);
+                a.max_y = max<long long>(a.max_y, p.y);
+            }
+        }
+    }
+
+    assert(r.rows_matched == matched);
+    assert(r.rows_scanned < total); // 2015 was skipped without a scan
+    assert(r.groups == want.size());
+    size_t g = 0;
+    for (const auto& [k, a] : want) {
+        assert(r.key_values[g * 3 + 0] == get<0>(k));
+        assert(r.key_values[g * 3 + 1] == get<1>(k));
+        assert(r.key_values[g * 3 + 2] == get<2>(k));
+        const double* v = &r.values[g * 5];
+        assert(v[0] == a.count);
+        assert(v[1] == a.seconds);
+        assert(std::fabs(v[2] - static_cast<double>(a.dist) / a.count) < 1e-9);
+        assert(v[3] == a.min_x);
+        assert(v[4] == a.max_y);
+        g++;
+    }
+
+    // No group-by: one row over everything.
+    query::query all;
+    all.select.push_back({});
+    auto everything = query::run(seasons, all);
+    assert(everything.groups == 1 && everything.values[0] == total);
+
+    query::order_by(r, 0, false, 3);
+    assert(r.groups == 3 && r.values[0] >= r.values[5] && r.values[5] >= r.values[10]);
+
+    for (int year : years) std::remove(store::season_path(".", year).c_str());
+    cout << "OK\n\n";
+}
+
+static void test_parse_errors() {
+    cout << "=== test_parse_errors ===\n";
+
+    for (const char* bad : {"nope=1", "type", "type=", "type=5x", "=4", "x<"}) {
+        bool threw = false;
+        try {
+            query::parse_predicate(bad);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw && "Expected parse_predicate() to reject malformed input");
+    }
+    for (const char* bad : {"avg", "count:x", "median:x", "sum:nope"}) {
+        bool threw = false;
+        try {
+            query::parse_aggregate(bad);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw && "Expected parse_aggregate() to reject malformed input");
+    }
+
+    auto p = query::parse_predicate("x>25");
+    assert(p.col == store::column::x && p.ranges.size() == 1 && p.ranges[0].first == 26 && !p.negate);
+    // Strict bounds past the ends of int64 match nothing instead of overflowing.
+    assert(query::parse_predicate("x<-9223372036854775808").ranges.empty());
+    assert(query::parse_predicate("x>9223372036854775807").ranges.empty());
+    p = query::parse_predicate("x<-9223372036854775807");
+    assert(p.ranges.size() == 1 && p.ranges[0].first == p.ranges[0].second);
+    assert(query::describe(query::parse_aggregate("avg:net_dist")) == "avg(net_dist)");
+
+    cout << "OK\n\n";
+}
+
+int main() {
+    try {
+        test_match_range();
+        test_season_roundtrip();
+        test_group_by_matches_naive();
+        test_parse_errors();
+
+        cout << "ALL TESTS PASSED ✅\n";
+    } catch (const std::exception& e) {
+        cerr << "Unhandled exception: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
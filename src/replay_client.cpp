@@ -0,0 +1,138 @@
+// Replays recorded (or synthetic) games against a running `nhl_transformer serve`
+// and reports round-trip latency and throughput.
+//
+//   ReplayClient --seasons 2023 --data-dir ../data --connections 16
+//   ReplayClient --synthetic 64 --plays 320 --connections 32
+
+#include "../include/play.hpp"
+#include "../include/inference_server.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using hml::play::play_event;
+namespace serving = hml::serving;
+
+static int connect_to(const std::string& path) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    std::string socket_path = "/tmp/nhl_transformer.sock";
+    std::string data_dir = "../data";
+    int first_season = 0;
+    int last_season = -1;
+    std::size_t max_games = 0;
+    std::size_t connections = 8;
+    std::size_t synthetic = 0;
+    std::size_t plays_per_game = 320;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if (arg == "--socket") socket_path = next();
+        else if (arg == "--data-dir") data_dir = next();
+        else if (arg == "--seasons") {
+            // "2023" or "2013-2024"
+            std::string v = next();
+            auto dash = v.find('-');
+            first_season = std::stoi(v.substr(0, dash));
+            last_season = dash == std::string::npos ? first_season : std::stoi(v.substr(dash + 1));
+        }
+        else if (arg == "--games") max_games = std::stoul(next());
+        else if (arg == "--connections") connections = std::stoul(next());
+        else if (arg == "--synthetic") synthetic = std::stoul(next());
+        else if (arg == "--plays") plays_per_game = std::stoul(next());
+        else {
+            std::cerr << "usage: ReplayClient [--socket PATH] [--seasons Y[-Y]] [--data-dir DIR] [--games N]\n"
+                         "                    [--synthetic N] [--plays N] [--connections N]\n";
+            return 2;
+        }
+    }
+
+    std::vector<std::vector<play_event>> games;
+    if (synthetic > 0) {
+        for (std::size_t g = 0; g < synthetic; g++) {
+            games.push_back(hml::play::synthetic_game(static_cast<std::uint32_t>(900000000 + g), plays_per_game, 42));
+        }
+    } else {
+        for (int year = first_season; year <= last_season; year++) {
+            auto season = hml::play::read_season(data_dir + "/" + std::to_string(year) + "_" + std::to_string(year + 1) + "_pbp.bin", year);
+            for (auto& g : season) games.push_back(std::move(g));
+        }
+    }
+    if (max_games > 0 && games.size() > max_games) games.resize(max_games);
+    if (games.empty()) {
+        std::cerr << "Nothing to replay (use --seasons or --synthetic)\n";
+        return 1;
+    }
+
+    std::atomic<std::size_t> next_game{0};
+    std::atomic<std::size_t> errors{0};
+    std::mutex lat_mutex;
+    std::vector<double> latencies_us;
+
+    auto worker = [&] {
+        int fd = connect_to(socket_path);
+        if (fd < 0) {
+            std::cerr << "Cannot connect to " << socket_path << "\n";
+            errors++;
+            return;
+        }
+        std::vector<double> local;
+        std::uint64_t request_id = 0;
+        for (std::size_t g = next_game++; g < games.size(); g = next_game++) {
+            for (const auto& p : games[g]) {
+                serving::request_frame req;
+                req.request_id = ++request_id;
+                req.play = p;
+                serving::response_frame resp;
+                auto start = std::chrono::steady_clock::now();
+                if (!serving::write_full(fd, &req, sizeof(req)) || !serving::read_full(fd, &resp, sizeof(resp))) {
+                    errors++;
+                    ::close(fd);
+                    return;
+                }
+                local.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+                if (resp.code != serving::status::ok || resp.request_id != req.request_id) errors++;
+            }
+        }
+        ::close(fd);
+        std::lock_guard<std::mutex> lock(lat_mutex);
+        latencies_us.insert(latencies_us.end(), local.begin(), local.end());
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> threads;
+        for (std::size_t c = 0; c < connections; c++) threads.emplace_back(worker);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto s = serving::summarize(latencies_us);
+    std::cout << "Replayed " << games.size() << " games, " << s.count << " plays over " << connections
+              << " connections in " << seconds << "s\n"
+              << "  throughput " << static_cast<double>(s.count) / seconds << " plays/s\n"
+              << "  latency    mean " << s.mean_us << "us  p50 " << s.p50_us << "us  p99 " << s.p99_us
+              << "us  max " << s.max_us << "us\n"
+              << "  errors     " << errors.load() << "\n";
+    return errors.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+// server_test.cpp
+// Tests for the inference server over its real Unix socket: replies match the
+// model, clients that come and go leave no descriptors behind, a client that
+// stops reading cannot hold up the others, and games that stop sending plays
+// give their sessions back.
+
+#include "../include/inference_server.hpp"
+#include "../include/model.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cassert>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+namespace serving = hml::serving;
+using hml::model::transformer;
+using hml::play::play_event;
+
+static hml::model::config small_config() {
+    hml::model::config cfg;
+    cfg.d_model = 16;
+    cfg.n_heads = 2;
+    cfg.n_layers = 1;
+    cfg.d_ff = 32;
+    cfg.max_seq = 64;
+    return cfg;
+}
+
+static size_t open_fds() {
+    size_t n = 0;
+    for ([[maybe_unused]] const auto& e : filesystem::directory_iterator("/proc/self/fd")) n++;
+    return n;
+}
+
+static int connect_to(const string& path) {
+    for (int attempt = 0; attempt < 200; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) return fd;
+        close(fd);
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+// Polls cond for up to two seconds.
+template <class Cond>
+static bool eventually(Cond cond) {
+    for (int i = 0; i < 200; i++) {
+        if (cond()) return true;
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    return cond();
+}
+
+static void test_replies_and_no_leaks() {
+    cout << "=== test_replies_and_no_leaks ===\n";
+
+    serving::server_options opts;
+    opts.socket_path = "/tmp/hml_server_test_" + to_string(getpid()) + ".sock";
+    opts.max_batch = 8;
+    opts.max_wait_us = 200;
+    const transformer reference(small_config(), 3);
+    serving::inference_server server(transformer(small_config(), 3), opts);
+    jthread runner([&] { server.run(); });
+    const size_t baseline = open_fds();
+
+    const size_t plays = 6;
+    hml::model::workspace ws(small_config(), 1, plays);
+    for (uint32_t client = 0; client < 24; client++) {
+        const auto game = hml::play::synthetic_game(2023020001u + client, plays, client);
+        int fd = connect_to(opts.socket_path);
+        assert(fd >= 0);
+        for (size_t i = 0; i < plays; i++) {
+            serving::request_frame req;
+            req.request_id = client * 100 + i;
+            req.play = game[i];
+            const bool sent = serving::write_full(fd, &req, sizeof(req));
+            assert(sent);
+        }
+
+        // Every third client hangs up without reading its replies.
+        if (client % 3 == 2) {
+            close(fd);
+            continue;
+        }
+        for (size_t i = 0; i < plays; i++) {
+            serving::response_frame resp;
+            const bool got = serving::read_full(fd, &resp, sizeof(resp));
+            assert(got);
+            assert(resp.code == serving::status::ok);
+            const size_t k = resp.request_id - client * 100;
+            assert(k < plays);
+
+            // Each reply scores the game's plays up to and including play k.
+            vector<span<const play_event>> prefix{span<const play_event>(game).first(k + 1)};
+            vector<hml::model::prediction> want(1);
+            reference.forward(prefix, ws, want);
+            assert(std::fabs(resp.win_prob - want[0].win_prob) < 1e-4f);
+            for (size_t e = 0; e < hml::play::vocab_size; e++) assert(std::fabs(resp.next_event[e] - want[0].next_event[e]) < 1e-4f);
+        }
+        close(fd);
+    }
+
+    const bool drained = eventually([&] { return server.connections() == 0 && open_fds() == baseline; });
+    assert(drained);
+    assert(server.stats().count >= 16 * plays);
+
+    server.stop();
+    runner.join();
+    cout << "OK\n\n";
+}
+
+// read_full with a deadline, so a stalled server fails the test instead of hanging it.
+static bool read_within(int fd, void* buf, size_t n, int timeout_ms) {
+    pollfd pfd{fd, POLLIN, 0};
+    return poll(&pfd, 1, timeout_ms) == 1 && serving::read_full(fd, buf, n);
+}
+
+static void test_stalled_reader_does_not_block_others() {
+    cout << "=== test_stalled_reader_does_not_block_others ===\n";
+
+    serving::server_options opts;
+    opts.socket_path = "/tmp/hml_server_test_stall_" + to_string(getpid()) + ".sock";
+    opts.max_reply_backlog = 8 << 10;
+    serving::inference_server server(transformer(small_config(), 9), opts);
+    jthread runner([&] { server.run(); });
+
+    // Far more replies than a socket buffer holds, never read.
+    int stalled = connect_to(opts.socket_path);
+    assert(stalled >= 0);
+    for (uint32_t g = 0; g < 40; g++) {
+        for (const auto& play : hml::play::synthetic_game(2023020201u + g, 200, g)) {
+            serving::request_frame req;
+            req.play = play;
+            const bool sent = serving::write_full(stalled, &req, sizeof(req));
+            assert(sent);
+        }
+    }
+
+    // Another client is still served promptly, and the stalled one is cut off.
+    int fd = connect_to(opts.socket_path);
+    assert(fd >= 0);
+    const auto game = hml::play::synthetic_game(2023020301u, 10, 7);
+    for (size_t i = 0; i < game.size(); i++) {
+        serving::request_frame req;
+        req.request_id = i;
+        req.play = game[i];
+        serving::response_frame resp;
+        const bool ok = serving::write_full(fd, &req, sizeof(req)) && read_within(fd, &resp, sizeof(resp), 5000);
+        assert(ok && resp.request_id == i && resp.code == serving::status::ok);
+    }
+    const bool dropped = eventually([&] { return server.connections() == 1; });
+    assert(dropped);
+
+    close(stalled);
+    close(fd);
+    server.stop();
+    runner.join();
+    cout << "OK\n\n";
+}
+
+static void test_idle_sessions_evicted() {
+    cout << "=== test_idle_sessions_evicted ===\n";
+
+    serving::server_options opts;
+    opts.socket_path = "/tmp/hml_server_test_idle_" + to_string(getpid()) + ".sock";
+    opts.session_idle_ms = 100;
+    const transformer reference(small_config(), 5);
+    serving::inference_server server(transformer(small_config(), 5), opts);
+    jthread runner([&] { server.run(); });
+
+    // Two games that never send game_end, from a client that then goes away.
+    const auto a = hml::play::synthetic_game(2023020101u, 20, 1);
+    const auto b = hml::play::synthetic_game(2023020102u, 20, 2);
+    int fd = connect_to(opts.socket_path);
+    assert(fd >= 0);
+    for (const auto* game : {&a, &b}) {
+        for (size_t i = 0; i < 3; i++) {
+            serving::request_frame req;
+            req.play = (*game)[i];
+            serving::response_frame resp;
+            const bool ok = serving::write_full(fd, &req, sizeof(req)) && serving::read_full(fd, &resp, sizeof(resp));
+            assert(ok && resp.code == serving::status::ok);
+        }
+    }
+    assert(server.sessions() == 2);
+    close(fd);
+
+    // Both sessions go without any further traffic to wake the server.
+    const bool evicted = eventually([&] { return server.sessions() == 0; });
+    assert(evicted);
+
+    // A game that comes back starts over from its next play.
+    fd = connect_to(opts.socket_path);
+    assert(fd >= 0);
+    serving::request_frame req;
+    req.play = a[3];
+    serving::response_frame resp;
+    const bool ok = serving::write_full(fd, &req, sizeof(req)) && serving::read_full(fd, &resp, sizeof(resp));
+    assert(ok && resp.code == serving::status::ok);
+    hml::model::workspace ws(small_config(), 1, 1);
+    vector<span<const play_event>> fresh{span<const play_event>(a).subspan(3, 1)};
+    vector<hml::model::prediction> want(1);
+    reference.forward(fresh, ws, want);
+    assert(std::fabs(resp.win_prob - want[0].win_prob) < 1e-4f);
+    assert(server.sessions() == 1);
+    close(fd);
+
+    server.stop();
+    runner.join();
+    cout << "OK\n\n";
+}
+
+static void test_rejects_bad_options() {
+    cout << "=== test_rejects_bad_options ===\n";
+
+    for (int which = 0; which < 2; which++) {
+        serving::server_options opts;
+        opts.socket_path = "/tmp/hml_server_test_bad_" + to_string(getpid()) + ".sock";
+        if (which == 0) opts.max_batch = 0;
+        else opts.session_idle_ms = 0;
+        bool threw = false;
+        try { serving::inference_server server(transformer(small_config(), 1), opts); } catch (const std::invalid_argument&) { threw = true; }
+        assert(threw);
+        assert(!filesystem::exists(opts.socket_path));
+    }
+
+    cout << "OK\n\n";
+}
+
+int main() {
+    try {
+        test_rejects_bad_options();
+        test_replies_and_no_leaks();
+        test_stalled_reader_does_not_block_others();
+        test_idle_sessions_evicted();
+
+        cout << "ALL TESTS PASSED ✅\n";
+    } catch (const std::exception& e) {
+        cerr << "Unhandled exception: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
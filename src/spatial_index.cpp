@@ -0,0 +1,415 @@
+#include "../include/spatial_index.hpp"
+#include "../include/thread_pool.hpp"
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hml::spatial {
+    inline constexpr std::size_t alignment = 64;
+    inline constexpr std::size_t num_sections = 10;
+
+    static std::size_t align_up(std::size_t x) { return (x + alignment - 1) & ~(alignment - 1); }
+
+    template <class T>
+    static void put(std::string& out, T v) {
+        out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    type_mask mask_of(std::span<const std::uint16_t> type_codes) {
+        type_mask m = 0;
+        for (auto code : type_codes) m |= type_mask{1} << play::event_index(code);
+        return m;
+    }
+
+    type_mask mask_of(std::initializer_list<std::uint16_t> type_codes) {
+        return mask_of(std::span<const std::uint16_t>(type_codes.begin(), type_codes.size()));
+    }
+
+    std::string grid_path(const std::string& dir, int year) {
+        return dir + "/" + std::to_string(year) + "_" + std::to_string(year + 1) + "_plays.grid";
+    }
+
+    // Integer extent of a cell; border cells also hold everything clamped into them.
+    static int cell_lo(std::size_t c, int origin) {
+        return c == 0 ? INT_MIN : origin + static_cast<int>(c) * cell_feet;
+    }
+    static int cell_hi(std::size_t c, int origin, std::size_t n) {
+        return c + 1 == n ? INT_MAX : origin + static_cast<int>(c + 1) * cell_feet - 1;
+    }
+
+    struct grid_index::owned {
+        std::vector<std::uint32_t> cell_start, rows;
+        std::vector<std::int16_t> x, y;
+        std::vector<std::uint8_t> type;
+        std::vector<std::uint32_t> counts, folded_counts;
+        std::vector<std::int32_t> players;
+        std::vector<std::uint32_t> player_start, player_points;
+    };
+
+    grid_index grid_index::build(const store::season& s) {
+        const auto* xs = s.get<std::int16_t>(store::column::x);
+        const auto* ys = s.get<std::int16_t>(store::column::y);
+        const auto* types = s.get<std::uint16_t>(store::column::type);
+        const auto* flags = s.get<std::uint8_t>(store::column::flags);
+        const auto* player = s.get<std::int32_t>(store::column::player);
+
+        auto o = std::make_shared<owned>();
+        std::vector<std::uint32_t> cells, folded;
+        std::vector<std::uint32_t> source;
+        for (std::size_t r = 0; r < s.rows(); r++) {
+            if (!(flags[r] & play::has_coords)) continue;
+            source.push_back(static_cast<std::uint32_t>(r));
+            cells.push_back(static_cast<std::uint32_t>(cell_of(xs[r], ys[r])));
+            folded.push_back(static_cast<std::uint32_t>(folded_cell_of(xs[r], ys[r])));
+        }
+        const std::size_t n = source.size();
+
+        // Counting sort by cell keeps rows ascending inside each cell.
+        o->cell_start.assign(num_cells + 1, 0);
+        for (auto c : cells) o->cell_start[c + 1]++;
+        std::partial_sum(o->cell_start.begin(), o->cell_start.end(), o->cell_start.begin());
+        std::vector<std::uint32_t> fill(o->cell_start.begin(), o->cell_start.end() - 1);
+        o->rows.resize(n);
+        o->x.resize(n);
+        o->y.resize(n);
+        o->type.resize(n);
+        o->counts.assign(play::vocab_size * num_cells, 0);
+        o->folded_counts.assign(play::vocab_size * num_cells, 0);
+        for (std::size_t i = 0; i < n; i++) {
+            const std::uint32_t r = source[i];
+            const std::uint32_t at = fill[cells[i]]++;
+            const auto t = static_cast<std::uint8_t>(play::event_index(types[r]));
+            o->rows[at] = r;
+            o->x[at] = xs[r];
+            o->y[at] = ys[r];
+            o->type[at] = t;
+            o->counts[t * num_cells + cells[i]]++;
+            o->folded_counts[t * num_cells + folded[i]]++;
+        }
+
+        // Per-player point lists, sorted by player then folded cell.
+        static_assert(num_cells <= 1024, "player_points packs cells in 10 bits");
+        std::vector<std::pair<std::int32_t, std::uint32_t>> by_player(n);
+        for (std::size_t i = 0; i < n; i++) {
+            const std::uint32_t r = source[i];
+            by_player[i] = {player[r], folded[i] << 18 | cells[i] << 8 | static_cast<std::uint32_t>(play::event_index(types[r]))};
+        }
+        std::sort(by_player.begin(), by_player.end());
+        o->player_points.resize(n);
+        for (std::size_t i = 0; i < n; i++) {
+            if (i == 0 || by_player[i].first != by_player[i - 1].first) {
+                o->players.push_back(by_player[i].first);
+                o->player_start.push_back(static_cast<std::uint32_t>(i));
+            }
+            o->player_points[i] = by_player[i].second;
+        }
+        o->player_start.push_back(static_cast<std::uint32_t>(n));
+
+        grid_index g;
+        g.year_ = s.year();
+        g.season_rows_ = s.rows();
+        g.cell_start_ = o->cell_start;
+        g.rows_ = o->rows;
+        g.x_ = o->x;
+        g.y_ = o->y;
+        g.type_ = o->type;
+        g.counts_ = o->counts;
+        g.folded_counts_ = o->folded_counts;
+        g.players_ = o->players;
+        g.player_start_ = o->player_start;
+        g.player_points_ = o->player_points;
+        g.storage_ = std::move(o);
+        return g;
+    }
+
+    void grid_index::save(const std::string& path) const {
+        const std::array<std::span<const std::byte>, num_sections> sections = {
+            std::as_bytes(cell_start_), std::as_bytes(rows_), std::as_bytes(x_), std::as_bytes(y_),
+            std::as_bytes(type_), std::as_bytes(counts_), std::as_bytes(folded_counts_), std::as_bytes(players_),
+            std::as_bytes(player_start_), std::as_bytes(player_points_),
+        };
+
+        std::string header;
+        header.append(magic, sizeof(magic));
+        put<std::uint32_t>(header, version);
+        put<std::uint32_t>(header, static_cast<std::uint32_t>(year_));
+        put<std::uint64_t>(header, season_rows_);
+        put<std::uint64_t>(header, rows_.size());
+        put<std::uint64_t>(header, players_.size());
+
+        std::size_t offset = align_up(header.size() + num_sections * 16);
+        std::array<std::size_t, num_sections> offsets{};
+        for (std::size_t i = 0; i < num_sections; i++) {
+            offsets[i] = offset;
+            put<std::uint64_t>(header, offset);
+            put<std::uint64_t>(header, sections[i].size());
+            offset = align_up(offset + sections[i].size());
+        }
+
+        // Same as column files: other queries may have the index mapped or be
+        // rebuilding it, so write a file of our own and rename it into place.
+        const std::string tmp = path + ".tmp." + std::to_string(::getpid());
+        std::ofstream outfile(tmp, std::ios::binary | std::ios::trunc);
+        if (!outfile) throw std::runtime_error("spatial: cannot open " + tmp);
+        static const char zeros[alignment] = {};
+        outfile.write(header.data(), static_cast<std::streamsize>(header.size()));
+        std::size_t pos = header.size();
+        for (std::size_t i = 0; i < num_sections; i++) {
+            outfile.write(zeros, static_cast<std::streamsize>(offsets[i] - pos));
+            outfile.write(reinterpret_cast<const char*>(sections[i].data()), static_cast<std::streamsize>(sections[i].size()));
+            pos = offsets[i] + sections[i].size();
+        }
+        outfile.close();
+        if (!outfile || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("spatial: write failed for " + path);
+        }
+    }
+
+    namespace {
+        struct reader {
+            const unsigned char* p;
+            const unsigned char* end;
+
+            template <class T>
+            T get() {
+                if (static_cast<std::size_t>(end - p) < sizeof(T)) throw std::runtime_error("spatial: truncated header");
+                T v;
+                std::memcpy(&v, p, sizeof(T));
+                p += sizeof(T);
+                return v;
+            }
+        };
+    }
+
+    grid_index grid_index::open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("spatial: cannot open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(magic))) {
+            ::close(fd);
+            throw std::runtime_error("spatial: not a grid file " + path);
+        }
+        const std::size_t file_size = static_cast<std::size_t>(st.st_size);
+        void* base = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) throw std::runtime_error("spatial: mmap failed for " + path);
+
+        grid_index g;
+        g.storage_ = std::shared_ptr<const void>(base, [file_size](const void* p) { ::munmap(const_cast<void*>(p), file_size); });
+
+        const auto* bytes = static_cast<const unsigned char*>(base);
+        reader r{bytes, bytes + file_size};
+        if (std::memcmp(r.p, magic, sizeof(magic)) != 0) throw std::runtime_error("spatial: bad magic in " + path);
+        r.p += sizeof(magic);
+        if (r.get<std::uint32_t>() != version) throw std::runtime_error("spatial: unsupported version in " + path);
+        g.year_ = static_cast<int>(r.get<std::uint32_t>());
+        g.season_rows_ = static_cast<std::size_t>(r.get<std::uint64_t>());
+        const std::size_t points = static_cast<std::size_t>(r.get<std::uint64_t>());
+        const std::size_t players = static_cast<std::size_t>(r.get<std::uint64_t>());
+
+        auto section = [&]<class T>(std::span<const T>& out, std::size_t count) {
+            const std::size_t offset = static_cast<std::size_t>(r.get<std::uint64_t>());
+            const std::size_t nbytes = static_cast<std::size_t>(r.get<std::uint64_t>());
+            if (nbytes != count * sizeof(T) || offset % alignment != 0 || offset > file_size || nbytes > file_size - offset)
+                throw std::runtime_error("spatial: corrupt section in " + path);
+            out = std::span<const T>(reinterpret_cast<const T*>(bytes + offset), count);
+        };
+        section(g.cell_start_, num_cells + 1);
+        section(g.rows_, points);
+        section(g.x_, points);
+        section(g.y_, points);
+        section(g.type_, points);
+        section(g.counts_, play::vocab_size * num_cells);
+        section(g.folded_counts_, play::vocab_size * num_cells);
+        section(g.players_, players);
+        section(g.player_start_, players + 1);
+        section(g.player_points_, points);
+        if (g.cell_start_.back() != points || g.player_start_.back() != points)
+            throw std::runtime_error("spatial: corrupt index in " + path);
+        return g;
+    }
+
+    namespace {
+        struct cell_span {
+            std::size_t cx0, cy0, cx1, cy1;
+        };
+
+        cell_span cells_of(const rect& r) {
+            const std::size_t a = cell_of(r.x0, r.y0);
+            const std::size_t b = cell_of(r.x1, r.y1);
+            return {a % grid_x, a / grid_x, b % grid_x, b / grid_x};
+        }
+
+        bool covers(const rect& r, std::size_t cx, std::size_t cy) {
+            return r.x0 <= cell_lo(cx, x_min) && cell_hi(cx, x_min, grid_x) <= r.x1
+                && r.y0 <= cell_lo(cy, y_min) && cell_hi(cy, y_min, grid_y) <= r.y1;
+        }
+    }
+
+    void grid_index::region(const rect& r, type_mask types, std::vector<std::uint32_t>& out) const {
+        out.clear();
+        if (r.x0 > r.x1 || r.y0 > r.y1) return;
+        const cell_span cs = cells_of(r);
+        for (std::size_t cy = cs.cy0; cy <= cs.cy1; cy++) {
+            for (std::size_t cx = cs.cx0; cx <= cs.cx1; cx++) {
+                const std::size_t c = cy * grid_x + cx;
+                const bool inside = covers(r, cx, cy);
+                for (std::uint32_t i = cell_start_[c]; i < cell_start_[c + 1]; i++) {
+                    if (!(types >> type_[i] & 1)) continue;
+                    if (inside || (x_[i] >= r.x0 && x_[i] <= r.x1 && y_[i] >= r.y0 && y_[i] <= r.y1)) out.push_back(rows_[i]);
+                }
+            }
+        }
+    }
+
+    std::size_t grid_index::count(const rect& r, type_mask types) const {
+        if (r.x0 > r.x1 || r.y0 > r.y1) return 0;
+        const cell_span cs = cells_of(r);
+        std::size_t total = 0;
+        for (std::size_t cy = cs.cy0; cy <= cs.cy1; cy++) {
+            for (std::size_t cx = cs.cx0; cx <= cs.cx1; cx++) {
+                const std::size_t c = cy * grid_x + cx;
+                if (covers(r, cx, cy)) {
+                    for (std::size_t t = 0; t < play::vocab_size; t++) {
+                        if (types >> t & 1) total += counts_[t * num_cells + c];
+                    }
+                    continue;
+                }
+                for (std::uint32_t i = cell_start_[c]; i < cell_start_[c + 1]; i++) {
+                    total += (types >> type_[i] & 1) && x_[i] >= r.x0 && x_[i] <= r.x1 && y_[i] >= r.y0 && y_[i] <= r.y1;
+                }
+            }
+        }
+        return total;
+    }
+
+    std::vector<neighbour> grid_index::nearest(float x, float y, std::size_t k, type_mask types) const {
+        auto farther = [](const neighbour& a, const neighbour& b) { return a.distance < b.distance; };
+        std::priority_queue<neighbour, std::vector<neighbour>, decltype(farther)> best(farther);
+        if (k == 0) return {};
+
+        const std::size_t start = cell_of(static_cast<int>(std::floor(x)), static_cast<int>(std::floor(y)));
+        const auto sx = static_cast<long>(start % grid_x);
+        const auto sy = static_cast<long>(start / grid_x);
+        auto visit = [&](long cx, long cy) {
+            if (cx < 0 || cy < 0 || cx >= static_cast<long>(grid_x) || cy >= static_cast<long>(grid_y)) return;
+            const std::size_t c = static_cast<std::size_t>(cy) * grid_x + static_cast<std::size_t>(cx);
+            for (std::uint32_t i = cell_start_[c]; i < cell_start_[c + 1]; i++) {
+                if (!(types >> type_[i] & 1)) continue;
+                const float dx = static_cast<float>(x_[i]) - x;
+                const float dy = static_cast<float>(y_[i]) - y;
+                const neighbour n{rows_[i], std::sqrt(dx * dx + dy * dy)};
+                if (best.size() < k) best.push(n);
+                else if (n.distance < best.top().distance) {
+                    best.pop();
+                    best.push(n);
+                }
+            }
+        };
+
+        // Rings of cells around the start cell. Everything in ring d is at least
+        // (d - 1) cells away, so stop once that bound passes the k-th best.
+        const long max_ring = static_cast<long>(std::max(grid_x, grid_y));
+        for (long d = 0; d <= max_ring; d++) {
+            if (best.size() == k && static_cast<float>((d - 1) * cell_feet) > best.top().distance) break;
+            if (d == 0) {
+                visit(sx, sy);
+                continue;
+            }
+            for (long cx = sx - d; cx <= sx + d; cx++) {
+                visit(cx, sy - d);
+                visit(cx, sy + d);
+            }
+            for (long cy = sy - d + 1; cy <= sy + d - 1; cy++) {
+                visit(sx - d, cy);
+                visit(sx + d, cy);
+            }
+        }
+
+        std::vector<neighbour> out(best.size());
+        for (std::size_t i = out.size(); i-- > 0;) {
+            out[i] = best.top();
+            best.pop();
+        }
+        return out;
+    }
+
+    void grid_index::add_heatmap(type_mask types, bool fold, heatmap& map) const {
+        if (map.empty()) map.assign(num_cells, 0);
+        const auto& counts = fold ? folded_counts_ : counts_;
+        for (std::size_t t = 0; t < play::vocab_size; t++) {
+            if (!(types >> t & 1)) continue;
+            for (std::size_t c = 0; c < num_cells; c++) map[c] += counts[t * num_cells + c];
+        }
+    }
+
+    void grid_index::add_player_heatmap(std::int32_t player_id, type_mask types, bool fold, heatmap& map) const {
+        if (map.empty()) map.assign(num_cells, 0);
+        auto it = std::lower_bound(players_.begin(), players_.end(), player_id);
+        if (it == players_.end() || *it != player_id) return;
+        const std::size_t p = static_cast<std::size_t>(it - players_.begin());
+        for (std::uint32_t i = player_start_[p]; i < player_start_[p + 1]; i++) {
+            const std::uint32_t packed = player_points_[i];
+            if (types >> (packed & 0xff) & 1) map[fold ? packed >> 18 : packed >> 8 & 0x3ff]++;
+        }
+    }
+
+    std::vector<grid_index> open_indexes(const std::string& dir, const std::vector<store::season>& seasons) {
+        namespace fs = std::filesystem;
+        std::vector<grid_index> out(seasons.size());
+        std::vector<std::exception_ptr> errors(seasons.size());
+        std::mutex log_mutex;
+
+        parallel::parallel_for(0, seasons.size(), 1, [&](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = lo; i < hi; i++) {
+                const store::season& s = seasons[i];
+                const std::string path = grid_path(dir, s.year());
+                std::error_code ec;
+                const auto col_time = fs::last_write_time(store::season_path(dir, s.year()), ec);
+                if (fs::exists(path, ec) && !(fs::last_write_time(path, ec) < col_time)) {
+                    try {
+                        grid_index g = grid_index::open(path);
+                        if (g.year() == s.year() && g.season_rows() == s.rows()) {
+                            out[i] = std::move(g);
+                            continue;
+                        }
+                    } catch (const std::exception&) {
+                        // Rebuilt below.
+                    }
+                }
+                try {
+                    out[i] = grid_index::build(s);
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                    continue;
+                }
+                try {
+                    out[i].save(path);
+                } catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(log_mutex);
+                    std::cerr << "Keeping index for " << s.year() << " in memory: " << e.what() << "\n";
+                }
+            }
+        });
+        // A season that could not be indexed at all fails the whole call, but only
+        // after every other season's task has finished.
+        for (const auto& e : errors) {
+            if (e) std::rethrow_exception(e);
+        }
+        return out;
+    }
+}
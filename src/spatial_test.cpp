@@ -0,0 +1,195 @@
+// spatial_test.cpp
+// Tests for the rink grid index: region, count and nearest-neighbour queries
+// and heatmaps against brute force over the season's rows, plus file round trips.
+
+#include "../include/play_store.hpp"
+#include "../include/spatial_index.hpp"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cassert>
+#include <cstdio>
+
+using namespace std;
+namespace store = hml::store;
+namespace spatial = hml::spatial;
+using hml::play::play_event;
+
+static store::season make_season(int year) {
+    vector<vector<play_event>> games;
+    for (uint32_t g = 0; g < 40; g++) {
+        games.push_back(hml::play::synthetic_game(static_cast<uint32_t>(year) * 1000000u + 20001u + g, 250, 5));
+    }
+    // Missing and off-grid coordinates.
+    games[0][3].flags = 0;
+    games[0][4].x = 100;
+    games[0][4].y = 45;
+    games[0][5].x = -120;
+    games[1][7].y = -60;
+    store::write_season(store::season_path(".", year), year, games);
+    return store::season::open(store::season_path(".", year));
+}
+
+static bool has_coords(const store::season& s, size_t r) {
+    return s.get<uint8_t>(store::column::flags)[r] & hml::play::has_coords;
+}
+
+static bool selected(const store::season& s, size_t r, spatial::type_mask types) {
+    return has_coords(s, r) && (types >> hml::play::event_index(s.get<uint16_t>(store::column::type)[r]) & 1);
+}
+
+static void test_region_and_count() {
+    cout << "=== test_region_and_count ===\n";
+
+    auto s = make_season(2021);
+    auto g = spatial::grid_index::build(s);
+    const auto* xs = s.get<int16_t>(store::column::x);
+    const auto* ys = s.get<int16_t>(store::column::y);
+
+    size_t with_coords = 0;
+    for (size_t r = 0; r < s.rows(); r++) with_coords += has_coords(s, r);
+    assert(g.points() == with_coords);
+
+    const spatial::type_mask shots = spatial::mask_of({505, 506, 507, 508});
+    mt19937 rng(3);
+    uniform_int_distribution<int> xd(-130, 130), yd(-60, 60);
+    vector<uint32_t> got;
+    for (int trial = 0; trial < 200; trial++) {
+        spatial::rect r{xd(rng), yd(rng), xd(rng), yd(rng)};
+        if (r.x0 > r.x1) swap(r.x0, r.x1);
+        if (r.y0 > r.y1) swap(r.y0, r.y1);
+        if (trial == 0) r = {-1000, -1000, 1000, 1000};
+        if (trial == 1) r = {25, -9, 89, 9};
+        const spatial::type_mask types = trial % 2 ? shots : spatial::all_types;
+
+        vector<uint32_t> want;
+        for (size_t i = 0; i < s.rows(); i++) {
+            if (selected(s, i, types) && xs[i] >= r.x0 && xs[i] <= r.x1 && ys[i] >= r.y0 && ys[i] <= r.y1) {
+                want.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        g.region(r, types, got);
+        sort(got.begin(), got.end());
+        assert(got == want);
+        assert(g.count(r, types) == want.size());
+    }
+
+    cout << "OK\n\n";
+}
+
+static void test_nearest() {
+    cout << "=== test_nearest ===\n";
+
+    auto s = make_season(2022);
+    auto g = spatial::grid_index::build(s);
+    const auto* xs = s.get<int16_t>(store::column::x);
+    const auto* ys = s.get<int16_t>(store::column::y);
+    const spatial::type_mask goals = spatial::mask_of({505});
+
+    mt19937 rng(11);
+    uniform_real_distribution<float> xd(-110.0f, 110.0f), yd(-50.0f, 50.0f);
+    for (int trial = 0; trial < 100; trial++) {
+        const float x = xd(rng), y = yd(rng);
+        const size_t k = 1 + static_cast<size_t>(trial % 12);
+        const spatial::type_mask types = trial % 3 == 0 ? goals : spatial::all_types;
+
+        vector<float> want;
+        for (size_t i = 0; i < s.rows(); i++) {
+            if (!selected(s, i, types)) continue;
+            want.push_back(std::hypot(static_cast<float>(xs[i]) - x, static_cast<float>(ys[i]) - y));
+        }
+        sort(want.begin(), want.end());
+        want.resize(min(k, want.size()));
+
+        auto got = g.nearest(x, y, k, types);
+        assert(got.size() == want.size());
+        for (size_t j = 0; j < got.size(); j++) {
+            assert(std::fabs(got[j].distance - want[j]) < 1e-3f);
+            const float d = std::hypot(static_cast<float>(xs[got[j].row]) - x, static_cast<float>(ys[got[j].row]) - y);
+            assert(std::fabs(d - got[j].distance) < 1e-3f);
+        }
+    }
+
+    cout << "OK\n\n";
+}
+
+static void test_heatmaps_and_files() {
+    cout << "=== test_heatmaps_and_files ===\n";
+
+    auto s = make_season(2023);
+    const auto* xs = s.get<int16_t>(store::column::x);
+    const auto* ys = s.get<int16_t>(store::column::y);
+    const auto* players = s.get<int32_t>(store::column::player);
+    const spatial::type_mask shots = spatial::mask_of({505, 506, 507});
+
+    // The first open builds and saves the index; the second maps the saved file.
+    vector<store::season> seasons{s};
+    auto built = spatial::open_indexes(".", seasons);
+    auto mapped = spatial::open_indexes(".", seasons);
+    auto loaded = spatial::grid_index::open(spatial::grid_path(".", 2023));
+    assert(loaded.points() == built[0].points() && loaded.year() == 2023 && loaded.season_rows() == s.rows());
+
+    const int32_t player = players[10];
+    for (bool fold : {false, true}) {
+        spatial::heatmap want_all(spatial::num_cells, 0), want_player(spatial::num_cells, 0);
+        for (size_t r = 0; r < s.rows(); r++) {
+            if (!selected(s, r, shots)) continue;
+            const size_t c = fold ? spatial::folded_cell_of(xs[r], ys[r]) : spatial::cell_of(xs[r], ys[r]);
+            want_all[c]++;
+            if (players[r] == player) want_player[c]++;
+        }
+
+        for (const auto* g : {&built[0], &mapped[0], &loaded}) {
+            spatial::heatmap all, mine;
+            g->add_heatmap(shots, fold, all);
+            g->add_player_heatmap(player, shots, fold, mine);
+            assert(all == want_all);
+            assert(mine == want_player);
+        }
+    }
+
+    // Saving over an index that is still mapped leaves the mapping intact.
+    spatial::heatmap before;
+    loaded.add_heatmap(shots, true, before);
+    built[0].save(spatial::grid_path(".", 2023));
+    spatial::heatmap after, reopened;
+    loaded.add_heatmap(shots, true, after);
+    spatial::grid_index::open(spatial::grid_path(".", 2023)).add_heatmap(shots, true, reopened);
+    assert(after == before && reopened == before);
+
+    spatial::heatmap nobody;
+    loaded.add_player_heatmap(-5, spatial::all_types, false, nobody);
+    assert(nobody.size() == spatial::num_cells && std::all_of(nobody.begin(), nobody.end(), [](auto v) { return v == 0; }));
+
+    // A play and its mirror image through centre ice land in the same folded
+    // cell, including either side of the cell boundaries at x = 0 and y = 0.
+    for (int x = -100; x <= 100; x++) {
+        for (int y = -45; y <= 45; y++) {
+            assert(spatial::folded_cell_of(x, y) == spatial::folded_cell_of(-x, -y));
+            assert(spatial::folded_cell_of(x, y) % spatial::grid_x >= spatial::grid_x / 2);
+        }
+    }
+    assert(spatial::folded_cell_of(-5, 0) == spatial::cell_of(5, 0));
+    assert(spatial::folded_cell_of(-80, 20) == spatial::cell_of(80, -20));
+
+    std::remove(spatial::grid_path(".", 2023).c_str());
+    for (int year : {2021, 2022, 2023}) std::remove(store::season_path(".", year).c_str());
+    cout << "OK\n\n";
+}
+
+int main() {
+    try {
+        test_region_and_count();
+        test_nearest();
+        test_heatmaps_and_files();
+
+        cout << "ALL TESTS PASSED ✅\n";
+    } catch (const std::exception& e) {
+        cerr << "Unhandled exception: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,15 +1,324 @@
 #include "../include/tensor.hpp"
+#include "../include/thread_pool.hpp"
 #include <numeric>
 #include <stdexcept>
 #include <limits>
+#include <functional>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
 
 namespace hml::tensor {
+    namespace detail {
+        static constexpr std::size_t storage_alignment = 64;
+        static constexpr std::size_t huge_page = std::size_t{2} << 20;
+
+        static std::size_t alignment_for(std::size_t bytes) {
+            return bytes >= huge_page ? huge_page : storage_alignment;
+        }
+
+        void* allocate_storage(std::size_t bytes) {
+            const std::size_t align = alignment_for(bytes);
+            void* p = ::operator new(bytes, std::align_val_t{align});
+#if defined(MADV_HUGEPAGE)
+            // Advisory only: without it the buffer just stays on 4 KB pages.
+            if (align == huge_page) ::madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+            return p;
+        }
+
+        void free_storage(void* p, std::size_t bytes) noexcept {
+            ::operator delete(p, std::align_val_t{alignment_for(bytes)});
+        }
+    }
+
+    // Elementwise kernels split the buffer into default_grain sized chunks; anything
+    // smaller runs inline on the caller.
+    template <class Op>
+    static void map_inplace(float* a, const float* b, std::size_t n, Op op) {
+        parallel::parallel_for(0, n, parallel::default_grain, [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = lo; i < hi; i++) a[i] = op(a[i], b[i]);
+        });
+    }
+
+    template <class Op>
+    static void map_inplace(float* a, float b, std::size_t n, Op op) {
+        parallel::parallel_for(0, n, parallel::default_grain, [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t i = lo; i < hi; i++) a[i] = op(a[i], b);
+        });
+    }
+
+    // --- transpose / permute kernels -------------------------------------------------
+
+    // Blocks at or below this edge length go to the tile kernel; larger blocks
+    // are split recursively.
+    static constexpr std::size_t transpose_tile = 128;
+    // The parallel split hands out square blocks of this edge (256 KB of source
+    // plus 256 KB of destination), which stay resident in L2 while transposed.
+    static constexpr std::size_t transpose_block_edge = 256;
+    // The tile kernel transposes stage x stage pieces into a small buffer and
+    // writes each buffer row out as one contiguous run. Storing 8x8 blocks
+    // straight into the destination touches 8 rows a power-of-two stride apart
+    // per block, which alias in L1 and cost several times the copy itself on
+    // large matrices. Buffer rows are padded so they do not alias each other.
+    static constexpr std::size_t transpose_stage = 32;
+    static constexpr std::size_t transpose_stage_ld = transpose_stage + 8;
+    // Outputs at least this large are written with streaming stores: they do
+    // not fit in cache anyway, and skipping the read-for-ownership halves the
+    // destination traffic.
+    static constexpr std::size_t transpose_stream_bytes = std::size_t{4} << 20;
+
+#if defined(__AVX__)
+    static inline void transpose_8x8(const float* src, std::size_t src_ld, float* dst, std::size_t dst_ld) {
+        __m256 r0 = _mm256_loadu_ps(src + 0 * src_ld);
+        __m256 r1 = _mm256_loadu_ps(src + 1 * src_ld);
+        __m256 r2 = _mm256_loadu_ps(src + 2 * src_ld);
+        __m256 r3 = _mm256_loadu_ps(src + 3 * src_ld);
+        __m256 r4 = _mm256_loadu_ps(src + 4 * src_ld);
+        __m256 r5 = _mm256_loadu_ps(src + 5 * src_ld);
+        __m256 r6 = _mm256_loadu_ps(src + 6 * src_ld);
+        __m256 r7 = _mm256_loadu_ps(src + 7 * src_ld);
+
+        __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+        __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+        __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+        __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+        __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+        __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+        __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+        __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+        __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+        _mm256_storeu_ps(dst + 0 * dst_ld, _mm256_permute2f128_ps(s0, s4, 0x20));
+        _mm256_storeu_ps(dst + 1 * dst_ld, _mm256_permute2f128_ps(s1, s5, 0x20));
+        _mm256_storeu_ps(dst + 2 * dst_ld, _mm256_permute2f128_ps(s2, s6, 0x20));
+        _mm256_storeu_ps(dst + 3 * dst_ld, _mm256_permute2f128_ps(s3, s7, 0x20));
+        _mm256_storeu_ps(dst + 4 * dst_ld, _mm256_permute2f128_ps(s0, s4, 0x31));
+        _mm256_storeu_ps(dst + 5 * dst_ld, _mm256_permute2f128_ps(s1, s5, 0x31));
+        _mm256_storeu_ps(dst + 6 * dst_ld, _mm256_permute2f128_ps(s2, s6, 0x31));
+        _mm256_storeu_ps(dst + 7 * dst_ld, _mm256_permute2f128_ps(s3, s7, 0x31));
+    }
+#else
+    static inline void transpose_8x8(const float* src, std::size_t src_ld, float* dst, std::size_t dst_ld) {
+        for (std::size_t i = 0; i < 8; i++) {
+            for (std::size_t j = 0; j < 8; j++) dst[j * dst_ld + i] = src[i * src_ld + j];
+        }
+    }
+#endif
+
+    // dst[j * dst_ld + i] = src[i * src_ld + j] for a rows x cols block of src.
+    static void transpose_direct(const float* src, std::size_t src_ld, float* dst, std::size_t dst_ld,
+                                 std::size_t rows, std::size_t cols) {
+        const std::size_t rows8 = rows & ~std::size_t{7};
+        const std::size_t cols8 = cols & ~std::size_t{7};
+        for (std::size_t j = 0; j < cols8; j += 8) {
+            for (std::size_t i = 0; i < rows8; i += 8) {
+                transpose_8x8(src + i * src_ld + j, src_ld, dst + j * dst_ld + i, dst_ld);
+            }
+        }
+        for (std::size_t i = 0; i < rows8; i++) {
+            for (std::size_t j = cols8; j < cols; j++) dst[j * dst_ld + i] = src[i * src_ld + j];
+        }
+        for (std::size_t i = rows8; i < rows; i++) {
+            for (std::size_t j = 0; j < cols; j++) dst[j * dst_ld + i] = src[i * src_ld + j];
+        }
+    }
+
+    // Copies one staged row of n floats to dst. Full rows that start on a cache
+    // line are streamed when `stream` is set.
+    static inline void store_staged_row(float* dst, const float* row, std::size_t n, bool stream) {
+#if defined(__AVX__)
+        if (stream && n == transpose_stage && (reinterpret_cast<std::uintptr_t>(dst) & 63) == 0) {
+            for (std::size_t k = 0; k < transpose_stage; k += 8) _mm256_stream_ps(dst + k, _mm256_load_ps(row + k));
+            return;
+        }
+#else
+        (void)stream;
+#endif
+        std::copy(row, row + n, dst);
+    }
+
+    // Streaming stores are weakly ordered; fence them before the task reports
+    // completion to the pool.
+    static inline void stream_fence(bool stream) {
+#if defined(__AVX__)
+        if (stream) _mm_sfence();
+#else
+        (void)stream;
+#endif
+    }
+
+    // Same contract as transpose_direct, staged through a buffer one
+    // transpose_stage square at a time.
+    static void transpose_tile_kernel(const float* src, std::size_t src_ld, float* dst, std::size_t dst_ld,
+                                      std::size_t rows, std::size_t cols, bool stream) {
+        constexpr std::size_t S = transpose_stage;
+        constexpr std::size_t P = transpose_stage_ld;
+        alignas(64) float stage[S * P];
+        for (std::size_t i0 = 0; i0 < rows; i0 += S) {
+            const std::size_t h = std::min(S, rows - i0);
+            for (std::size_t j0 = 0; j0 < cols; j0 += S) {
+                const std::size_t w = std::min(S, cols - j0);
+                transpose_direct(src + i0 * src_ld + j0, src_ld, stage, P, h, w);
+                for (std::size_t j = 0; j < w; j++) {
+                    store_staged_row(dst + (j0 + j) * dst_ld + i0, stage + j * P, h, stream);
+                }
+            }
+        }
+    }
+
+    // Cache-oblivious: halve the longer side (on a multiple of 8) until the block is a tile.
+    static void transpose_block(const float* src, std::size_t src_ld, float* dst, std::size_t dst_ld,
+                                std::size_t rows, std::size_t cols, bool stream) {
+        if (rows <= transpose_tile && cols <= transpose_tile) {
+            transpose_tile_kernel(src, src_ld, dst, dst_ld, rows, cols, stream);
+        } else if (rows >= cols) {
+            const std::size_t half = (rows / 2 + 7) & ~std::size_t{7};
+            transpose_block(src, src_ld, dst, dst_ld, half, cols, stream);
+            transpose_block(src + half * src_ld, src_ld, dst + half, dst_ld, rows - half, cols, stream);
+        } else {
+            const std::size_t half = (cols / 2 + 7) & ~std::size_t{7};
+            transpose_block(src, src_ld, dst, dst_ld, rows, half, stream);
+            transpose_block(src + half, src_ld, dst + half * dst_ld, dst_ld, rows, cols - half, stream);
+        }
+    }
+
+    // Copies the strided view (shape, strides) over src into dst as a contiguous
+    // row-major tensor. Dims are coalesced first, then the copy is done as
+    // contiguous row memcpys, a batch of tiled 2D transposes, or a strided gather,
+    // depending on where the unit-stride source dim ended up.
+    static void materialize(const float* src, const std::vector<std::size_t>& shape,
+                            const std::vector<std::size_t>& strides, float* dst) {
+        std::vector<std::size_t> dims;
+        std::vector<std::size_t> src_st;
+        for (std::size_t d = 0; d < shape.size(); d++) {
+            if (shape[d] == 1) continue;
+            if (!dims.empty() && src_st.back() == strides[d] * shape[d]) {
+                dims.back() *= shape[d];
+                src_st.back() = strides[d];
+                continue;
+            }
+            dims.push_back(shape[d]);
+            src_st.push_back(strides[d]);
+        }
+        if (dims.empty()) {
+            dst[0] = src[0];
+            return;
+        }
+
+        const std::size_t nd = dims.size();
+        std::vector<std::size_t> dst_st(nd);
+        dst_st[nd - 1] = 1;
+        for (std::size_t d = nd - 1; d-- > 0; ) dst_st[d] = dst_st[d + 1] * dims[d + 1];
+        const std::size_t total = dst_st[0] * dims[0];
+
+        // Source dim with unit stride, if any.
+        std::size_t unit = nd;
+        for (std::size_t d = 0; d < nd; d++) {
+            if (src_st[d] == 1) unit = d;
+        }
+
+        // Dims walked by the outer (parallel) loop; the inner kernel handles the rest.
+        std::vector<std::size_t> outer;
+        for (std::size_t d = 0; d + 1 < nd; d++) {
+            if (d != unit) outer.push_back(d);
+        }
+        std::size_t outer_count = 1;
+        for (std::size_t d : outer) outer_count *= dims[d];
+
+        auto offsets = [&](std::size_t o, std::size_t& s_off, std::size_t& d_off) {
+            s_off = 0;
+            d_off = 0;
+            for (std::size_t k = outer.size(); k-- > 0; ) {
+                const std::size_t d = outer[k];
+                const std::size_t idx = o % dims[d];
+                o /= dims[d];
+                s_off += idx * src_st[d];
+                d_off += idx * dst_st[d];
+            }
+        };
+
+        const std::size_t last = nd - 1;
+        if (unit < last) {
+            // Source is [last][unit] with unit contiguous, destination is [unit][last].
+            // Each matrix is cut into square blocks as well so one big matrix still
+            // spreads out, and every task works on an L2-sized piece of both sides.
+            const std::size_t rows = dims[last];
+            const std::size_t cols = dims[unit];
+            const std::size_t edge = transpose_block_edge;
+            const std::size_t row_blocks = (rows + edge - 1) / edge;
+            const std::size_t col_blocks = (cols + edge - 1) / edge;
+            const std::size_t blocks = row_blocks * col_blocks;
+            const std::size_t block_cost = std::min(edge, rows) * std::min(edge, cols);
+            const bool stream = total * sizeof(float) >= transpose_stream_bytes;
+            parallel::parallel_for(0, outer_count * blocks, parallel::grain_for(block_cost), [&](std::size_t lo, std::size_t hi) {
+                std::size_t s_off, d_off;
+                for (std::size_t t = lo; t < hi; t++) {
+                    offsets(t / blocks, s_off, d_off);
+                    const std::size_t r0 = (t % blocks) / col_blocks * edge;
+                    const std::size_t c0 = (t % blocks) % col_blocks * edge;
+                    transpose_block(src + s_off + r0 * src_st[last] + c0, src_st[last],
+                                    dst + d_off + c0 * dst_st[unit] + r0, dst_st[unit],
+                                    std::min(edge, rows - r0), std::min(edge, cols - c0), stream);
+                }
+                stream_fence(stream);
+            });
+            return;
+        }
+
+        if (outer_count == 1 && unit == last) {
+            parallel::parallel_for(0, total, parallel::default_grain, [&](std::size_t lo, std::size_t hi) {
+                std::copy(src + lo, src + hi, dst + lo);
+            });
+            return;
+        }
+
+        const std::size_t inner = total / outer_count;
+        parallel::parallel_for(0, outer_count, parallel::grain_for(inner), [&](std::size_t lo, std::size_t hi) {
+            std::size_t s_off, d_off;
+            for (std::size_t o = lo; o < hi; o++) {
+                offsets(o, s_off, d_off);
+                if (unit == last) {
+                    std::copy_n(src + s_off, dims[last], dst + d_off);
+                } else {
+                    const float* s = src + s_off;
+                    float* t = dst + d_off;
+                    const std::size_t st = src_st[last];
+                    for (std::size_t j = 0; j < dims[last]; j++) t[j] = s[j * st];
+                }
+            }
+        });
+    }
+
     tensor::tensor() noexcept {
         shape_.clear();
         strides_.clear();
         data_.clear();
     }
     tensor::tensor(std::span<const size_t> dims){
+        data_.assign(set_layout(dims), 0.0f);
+    }
+
+    tensor tensor::uninitialized(std::span<const std::size_t> dims) {
+        tensor res;
+        res.data_.resize(res.set_layout(dims));
+        return res;
+    }
+
+    std::size_t tensor::set_layout(std::span<const std::size_t> dims) {
         if (dims.empty()) {
             throw std::invalid_argument("tensor: shape must have at least 1 dimension");
         }    
@@ -30,166 +339,174 @@ namespace hml::tensor {
         for (int i = static_cast<int>(shape_.size()) - 2; i >= 0; i--){
             strides_[i] = strides_[i + 1] * shape_[i + 1];
         }
-
-        data_.resize(numel);
+        return numel;
     }
 
     tensor::tensor(std::initializer_list<size_t> dims) 
         : tensor(std::span<const std::size_t>(dims.begin(), dims.size())) {}
 
+    // Copies always own their data, so writing to a copy never touches the
+    // memory an external tensor points into.
+    tensor::tensor(const tensor& x)
+        : data_(x.data(), x.data() + x.size()), shape_(x.shape_), strides_(x.strides_) {}
+
+    tensor::tensor(tensor&& x) noexcept
+        : data_(std::move(x.data_)), shape_(std::move(x.shape_)), strides_(std::move(x.strides_)),
+          owner_(std::move(x.owner_)), external_(std::exchange(x.external_, nullptr)),
+          external_size_(std::exchange(x.external_size_, 0)) {}
+
+    tensor& tensor::operator=(const tensor& x) {
+        if (this == &x) return *this;
+        data_.assign(x.data(), x.data() + x.size());
+        shape_ = x.shape_;
+        strides_ = x.strides_;
+        owner_.reset();
+        external_ = nullptr;
+        external_size_ = 0;
+        return *this;
+    }
+
+    tensor& tensor::operator=(tensor&& x) noexcept {
+        if (this == &x) return *this;
+        data_ = std::move(x.data_);
+        shape_ = std::move(x.shape_);
+        strides_ = std::move(x.strides_);
+        owner_ = std::move(x.owner_);
+        external_ = std::exchange(x.external_, nullptr);
+        external_size_ = std::exchange(x.external_size_, 0);
+        return *this;
+    }
+
+    tensor tensor::from_external(std::span<const std::size_t> dims, float* data, std::shared_ptr<void> owner) {
+        if (data == nullptr) throw std::invalid_argument("tensor: external data must not be null");
+        tensor res;
+        res.external_size_ = res.set_layout(dims);
+        res.external_ = data;
+        res.owner_ = std::move(owner);
+        return res;
+    }
+
+    bool tensor::is_external() const noexcept { return external_ != nullptr; }
+
     tensor tensor::operator+(const tensor& x) const {
         if (this->shape_ != x.shape_) throw std::invalid_argument("tensor: tensors must be the same shape");
+        if (!this->is_contiguous() || !x.is_contiguous()) return this->contiguous() + x.contiguous();
         tensor res = *this;
-        for (std::size_t i = 0; i < data_.size(); i++){
-            res.data_[i] += x.data_[i];
-        }
+        map_inplace(res.data(), x.data(), size(), std::plus<float>{});
         return res;
     }
     tensor tensor::operator+(float x) const {
         tensor res = *this;
-        for (std::size_t i = 0; i < data_.size(); i++){
-            res.data_[i] += x;
-        }
+        map_inplace(res.data(), x, size(), std::plus<float>{});
         return res;
     }
 
     tensor& tensor::operator+=(const tensor& x) {
         if (this->shape_ != x.shape_) throw std::invalid_argument("tensor: tensors must be the same shape");
-        for (std::size_t i = 0; i < data_.size(); i++){
-            this->data_[i] += x.data_[i];
-        }
+        if (!this->is_contiguous()) *this = this->contiguous();
+        if (!x.is_contiguous()) return *this += x.contiguous();
+        map_inplace(this->data(), x.data(), size(), std::plus<float>{});
         return *this;
     }
     tensor& tensor::operator+=(float x) {
-        for (std::size_t i = 0; i < data_.size(); i++){
-            this->data_[i] += x;
-        }
+        map_inplace(this->data(), x, size(), std::plus<float>{});
         return *this;
     }
 
     tensor tensor::operator-(const tensor& x) const {
         if (this->shape_ != x.shape_) throw std::invalid_argument("tensor: tensors must be the same shape");
+        if (!this->is_contiguous() || !x.is_contiguous()) return this->contiguous() - x.contiguous();
         tensor res = *this;
-        for (std::size_t i = 0; i < data_.size(); i++){
-            res.data_[i] -= x.data_[i];
-        }
+        map_inplace(res.data(), x.data(), size(), std::minus<float>{});
         return res;
     }
     tensor tensor::operator-(float x) const {
         tensor res = *this;
-        for (std::size_t i = 0; i < data_.size(); i++){
-            res.data_[i] -= x;
-        }
+        map_inplace(res.data(), x, size(), std::minus<float>{});
         return res;
     }
 
     tensor& tensor::operator-=(const tensor& x) {
         if (this->shape_ != x.shape_) throw std::invalid_argument("tensor: tensors must be the same shape");
-        for (std::size_t i = 0; i < data_.size(); i++){
-            this->data_[i] -= x.data_[i];
-        }
+        if (!this->is_contiguous()) *this = this->contiguous();
+        if (!x.is_contiguous()) return *this -= x.contiguous();
+        map_inplace(this->data(), x.data(), size(), std::minus<float>{});
         return *this;
     }
     tensor& tensor::operator-=(float x) {
-        for (std::size_t i = 0; i < data_.size(); i++){
-            this->data_[i] -= x;
-        }
+        map_inplace(this->data(), x, size(), std::minus<float>{});
         return *this;
     }
 
     tensor tensor::operator*(const tensor& x) const {
         if (this->shape_ != x.shape_) throw std::invalid_argument("tensor: tensors must be the same shape");
+        if (!this->is_contiguous() || !x.is_contiguous()) return this->contiguous() * x.contiguous();
         tensor res = *this;
-        for (std::size_t i = 0; i < data_.size(); i++){
-            res.data_[i] *= x.data_[i];
-        }
+        map_inplace(res.data(), x.data(), size(), std::multiplies<float>{});
         return res;
     }
     tensor tensor::operator*(float x) const {
         tensor res = *this;
-        for (std::size_t i = 0; i < data_.size(); i++){
-            res.data_[i] *= x;
-        }
+        map_inplace(res.data(), x, size(), std::multiplies<float>{});
         return res;
     }
 
     tensor& tensor::operator*=(const tensor& x) {
         if (this->shape_ != x.shape_) throw std::invalid_argument("tensor: tensors must be the same shape");
-        for (std::size_t i = 0; i < data_.size(); i++){
-            this->data_[i] *= x.data_[i];
-        }
+        if (!this->is_contiguous()) *this = this->contiguous();
+        if (!x.is_contiguous()) return *this *= x.contiguous();
+        map_inplace(this->data(), x.data(), size(), std::multiplies<float>{});
         return *this;
     }
     tensor& tensor::operator*=(float x) {
-        for (std::size_t i = 0; i < data_.size(); i++){
-            this->data_[i] *= x;
-        }
+        map_inplace(this->data(), x, size(), std::multiplies<float>{});
         return *this;
     }
 
     tensor tensor::operator/(const tensor& x) const {
         if (this->shape_ != x.shape_) throw std::invalid_argument("tensor: tensors must be the same shape");
+        if (!this->is_contiguous() || !x.is_contiguous()) return this->contiguous() / x.contiguous();
 
         tensor res = *this;
-        for (std::size_t i = 0; i < data_.size(); i++){
-            res.data_[i] /= x.data_[i];
-        }
+        map_inplace(res.data(), x.data(), size(), std::divides<float>{});
         return res;
     }
 
     tensor tensor::operator/(float x) const {
         tensor res = *this;
-        for (std::size_t i = 0; i < data_.size(); i++){
-            res.data_[i] /= x;
-        }
+        map_inplace(res.data(), x, size(), std::divides<float>{});
         return res;
     }
 
     tensor& tensor::operator/=(const tensor& x) {
         if (this->shape_ != x.shape_) throw std::invalid_argument("tensor: tensors must be the same shape");
-        for (std::size_t i = 0; i < data_.size(); i++){
-            this->data_[i] /= x.data_[i];
-        }
+        if (!this->is_contiguous()) *this = this->contiguous();
+        if (!x.is_contiguous()) return *this /= x.contiguous();
+        map_inplace(this->data(), x.data(), size(), std::divides<float>{});
         return *this;
     }
     tensor& tensor::operator/=(float x) {
-        for (std::size_t i = 0; i < data_.size(); i++){
-            this->data_[i] /= x;
-        }
+        map_inplace(this->data(), x, size(), std::divides<float>{});
         return *this;
     }
 
     tensor tensor::transpose() const {
         if (this->shape_.size() < 2) throw std::invalid_argument("Can not transpose empty matrix");
-        else if (this->shape_.size() == 2) {
-            tensor res{this->shape_[1], this->shape_[0]};
-            for (std::size_t i = 0; i < this->shape_[0]; i++) {
-                for (std::size_t j = 0; j < this->shape_[1]; j++) {
-                    res.data_[j * res.shape_[1] + i] = this->data_[i * this->shape_[1] + j];
-                }   
-            }
-            return res;
-        }
-        else {
-            std::vector<std::size_t> new_shape(this->shape_);
-            std::swap(new_shape[new_shape.size() - 2], new_shape[new_shape.size() - 1]);
-            tensor res{new_shape};
-            std::size_t num_matrices = 1;
-            for (std::size_t s = 0; s < res.shape_.size() - 2; s++){
-                num_matrices *=  res.shape_[s];
-            }
-            std::size_t m = this->shape_[this->shape_.size() - 2];
-            std::size_t n = this->shape_[this->shape_.size() - 1];
-            for (std::size_t m_i = 0; m_i < num_matrices; m_i++){
-                std::size_t offset = m_i * m * n;
-                for (std::size_t i = 0; i < m; i++) {
-                    for (std::size_t j = 0; j < n; j++){
-                        res.data_[offset + j*m + i] = this->data_[offset + i * n + j];
-                    }
-                }
-            } 
-            return res;
-        }
+        const std::size_t nd = this->shape_.size();
+        std::vector<std::size_t> new_shape(this->shape_);
+        std::vector<std::size_t> new_strides(this->strides_);
+        std::swap(new_shape[nd - 2], new_shape[nd - 1]);
+        std::swap(new_strides[nd - 2], new_strides[nd - 1]);
+        tensor res = uninitialized(new_shape);
+        materialize(this->data(), new_shape, new_strides, res.data());
+        return res;
+    }
+
+    tensor tensor::contiguous() const {
+        if (this->is_contiguous()) return *this;
+        tensor res = uninitialized(this->shape_);
+        materialize(this->data(), this->shape_, this->strides_, res.data());
+        return res;
     }
 
     static std::size_t prod(const std::vector<std::size_t>& v, std::size_t start, std::size_t end){
@@ -200,7 +517,7 @@ namespace hml::tensor {
 
     tensor tensor::matmul(const tensor& x) const {
         if (!this->is_contiguous() || !x.is_contiguous())
-            throw std::invalid_argument("tensor: matmul requires contiguous tensors");
+            return this->contiguous().matmul(x.contiguous());
 
         std::vector<std::size_t> a_shape = this->shape_;
         std::vector<std::size_t> b_shape = x.shape_;
@@ -280,9 +597,9 @@ namespace hml::tensor {
         const bool A_batched = !a_batch_shape.empty();
         const bool B_batched = !b_batch_shape.empty();
 
-        const float* A = this->data_.data();
-        const float* B = x.data_.data();
-        float* C = out.data_.data();
+        const float* A = this->data();
+        const float* B = x.data();
+        float* C = out.data();
 
         // For output, if you returned [m] or [p] for vector-ish results,
         // you still compute into an implicit [m,1] or [1,p] internally.
@@ -290,15 +607,18 @@ namespace hml::tensor {
         const std::size_t C_p = b_p;
         const std::size_t C_block = C_m * C_p;
 
-        for (std::size_t b = 0; b < batch_count; b++) {
-            const std::size_t a_b = A_batched ? b : 0;
-            const std::size_t b_b = B_batched ? b : 0;
+        // Each output row costs a_n * b_p multiply-adds; split over (batch, row) pairs.
+        parallel::parallel_for(0, batch_count * a_m, parallel::grain_for(a_n * b_p), [=](std::size_t lo, std::size_t hi) {
+            for (std::size_t r = lo; r < hi; r++) {
+                const std::size_t b = r / a_m;
+                const std::size_t i = r % a_m;
+                const std::size_t a_b = A_batched ? b : 0;
+                const std::size_t b_b = B_batched ? b : 0;
 
-            const std::size_t a_base = a_b * A_block;
-            const std::size_t b_base = b_b * B_block;
-            const std::size_t c_base = b * C_block;
+                const std::size_t a_base = a_b * A_block;
+                const std::size_t b_base = b_b * B_block;
+                const std::size_t c_base = b * C_block;
 
-            for (std::size_t i = 0; i < a_m; i++) {
                 for (std::size_t j = 0; j < b_p; j++) {
                     float sum = 0.0f;
                     for (std::size_t t = 0; t < a_n; t++) {
@@ -307,20 +627,39 @@ namespace hml::tensor {
                     C[c_base + i * b_p + j] = sum;
                 }
             }
-        }
+        });
 
         return out;
     }
 
-    tensor& reshape(std::span<const std::size_t> dims){
-        if (dims.size() < 1) throw std::invalid argument("Invalid dimensions, length must be greater than 1");
+    float tensor::sum() const {
+        const float* p = data();
+        double total = parallel::parallel_reduce(0, size(), parallel::default_grain, 0.0,
+            [=](std::size_t lo, std::size_t hi) {
+                double acc = 0.0;
+                for (std::size_t i = lo; i < hi; i++) acc += p[i];
+                return acc;
+            },
+            std::plus<double>{});
+        return static_cast<float>(total);
+    }
+
+    float tensor::mean() const {
+        if (size() == 0) throw std::invalid_argument("tensor: mean of empty tensor");
+        return sum() / static_cast<float>(size());
+    }
+
+    tensor& tensor::reshape(std::span<const std::size_t> dims){
+        if (dims.size() < 1) throw std::invalid_argument("Invalid dimensions, length must be greater than 1");
         std::size_t size = 1;
         for (std::size_t i = 0; i < dims.size(); i++) { 
             if (dims[i] < 1) throw std::invalid_argument("Invalid dimensions, each must be larger than 0"); 
             size *= dims[i]; 
         }
         if (size != this->size()) throw std::invalid_argument("Reshape must take same number of elements");
-        this->shape_ = dims;
+        if (!this->is_contiguous()) *this = this->contiguous();
+        this->shape_.assign(dims.begin(), dims.end());
+        this->strides_.resize(this->shape_.size());
         this->strides_.back() = 1;
         for (int i = static_cast<int>(this->shape_.size()) - 2; i >= 0; i--){
             this->strides_[i] = this->strides_[i + 1] * this->shape_[i + 1];
@@ -329,25 +668,52 @@ namespace hml::tensor {
     }
 
    
-    tensor unsqueeze(std::size_t dim) {
+    tensor tensor::unsqueeze(std::size_t dim) {
         if (dim > this->shape_.size()) throw std::invalid_argument("Inalid dimension, must be within 1 of current dimension");
-        if (dim < 0) dim += (this->shape_.size() + 1); 
-        std::vector<std::size_t> new_shape = this->shape_;
-        tensor res = this;
+        tensor res = *this;
+        std::size_t stride = dim < res.shape_.size() ? res.strides_[dim] * res.shape_[dim] : 1;
         res.shape_.insert(res.shape_.begin() + dim, 1);
+        res.strides_.insert(res.strides_.begin() + dim, stride);
         return res;
     }
         
 
+    tensor tensor::squeeze(std::size_t dim) {
+        if (dim >= this->shape_.size()) throw std::invalid_argument("Invalid dimension, must be less than ndim");
+        if (this->shape_[dim] != 1) throw std::invalid_argument("Can only squeeze a dimension of size 1");
+        if (this->shape_.size() == 1) throw std::invalid_argument("Can not squeeze the only dimension");
+        tensor res = *this;
+        res.shape_.erase(res.shape_.begin() + dim);
+        res.strides_.erase(res.strides_.begin() + dim);
+        return res;
+    }
+
+    tensor& tensor::permute(std::span<const std::size_t> axes) {
+        if (axes.size() != this->shape_.size()) throw std::invalid_argument("permute: need one axis per dimension");
+        std::vector<bool> seen(axes.size(), false);
+        std::vector<std::size_t> new_shape(axes.size());
+        std::vector<std::size_t> new_strides(axes.size());
+        for (std::size_t i = 0; i < axes.size(); i++) {
+            if (axes[i] >= axes.size() || seen[axes[i]]) throw std::invalid_argument("permute: axes must be a permutation");
+            seen[axes[i]] = true;
+            new_shape[i] = this->shape_[axes[i]];
+            new_strides[i] = this->strides_[axes[i]];
+        }
+        // Only the view changes; contiguous() (or the next op that needs it) runs the copy.
+        this->shape_ = std::move(new_shape);
+        this->strides_ = std::move(new_strides);
+        return *this;
+    }
+
     std::size_t tensor::ndim() const { return shape_.size(); } 
-    std::size_t tensor::numel() const { return data_.size(); } 
+    std::size_t tensor::numel() const { return size(); } 
 
     const std::vector<std::size_t>& tensor::get_shape() const noexcept { return shape_; } 
-    const std::vector<float>& tensor::get_data() const noexcept { return data_; }
+    std::span<const float> tensor::get_data() const noexcept { return {data(), size()}; }
     
-    const float* tensor::data() const noexcept { return data_.data(); }
-    float* tensor::data() noexcept { return data_.data(); }
-    std::size_t tensor::size() const noexcept { return data_.size(); }
+    const float* tensor::data() const noexcept { return external_ ? external_ : data_.data(); }
+    float* tensor::data() noexcept { return external_ ? external_ : data_.data(); }
+    std::size_t tensor::size() const noexcept { return external_ ? external_size_ : data_.size(); }
 
     bool tensor::is_contiguous() const {
         if (this->shape_.empty()) { return true; }
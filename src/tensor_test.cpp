@@ -7,12 +7,27 @@
 //   ./test_tensor
 
 #include "../include/tensor.hpp"
+#include "../include/checkpoint.hpp"
+#include "../include/thread_pool.hpp"
 
 #include <iostream>
 #include <vector>
 #include <stdexcept>
 #include <cmath>
 #include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unistd.h>
 
 using namespace std;
 using hml::tensor::tensor;
@@ -238,6 +253,305 @@ static void test_batched_matmul() {
     cout << "OK\n\n";
 }
 
+static void test_parallel_large_ops() {
+    cout << "=== test_parallel_large_ops ===\n";
+
+    // Big enough to be split across the thread pool.
+    tensor a{512, 384};
+    tensor b{512, 384};
+    fill_seq(a, 0.0f, 0.001f);
+    fill_seq(b, 1.0f, 0.002f);
+
+    tensor c = a * b;
+    c += 1.0f;
+    for (size_t i = 0; i < c.size(); i++) {
+        assert(nearly_equal(c.data()[i], a.data()[i] * b.data()[i] + 1.0f, 1e-2f));
+    }
+
+    tensor at = a.transpose();
+    expect_shape(at, {384, 512});
+    for (size_t i = 0; i < 512; i++) {
+        for (size_t j = 0; j < 384; j++) {
+            assert(at.data()[j * 512 + i] == a.data()[i * 384 + j]);
+        }
+    }
+
+    tensor ones{512, 384};
+    ones += 1.0f;
+    assert(nearly_equal(ones.sum(), 512.0f * 384.0f));
+    assert(nearly_equal(ones.mean(), 1.0f));
+
+    tensor A{4, 64, 128};
+    tensor B{128, 96};
+    fill_seq(A, -1.0f, 0.0001f);
+    fill_seq(B, 0.5f, -0.0001f);
+    tensor C = A.matmul(B);
+    expect_shape(C, {4, 64, 96});
+    for (size_t bb = 0; bb < 4; bb++) {
+        for (size_t i = 0; i < 64; i += 7) {
+            for (size_t j = 0; j < 96; j += 5) {
+                float sum = 0.0f;
+                for (size_t t = 0; t < 128; t++) {
+                    sum += A.data()[bb*64*128 + i*128 + t] * B.data()[t*96 + j];
+                }
+                assert(nearly_equal(sum, C.data()[bb*64*96 + i*96 + j], 1e-3f));
+            }
+        }
+    }
+
+    cout << "OK\n\n";
+}
+
+static void test_transpose_odd_sizes() {
+    cout << "=== test_transpose_odd_sizes ===\n";
+
+    // Sizes that are not multiples of the 8x8 kernel, the 32 stage, the 128 tile
+    // or the 256 parallel block, including blocks thinner than the kernel on
+    // either side. The last two are large enough to take the streaming path,
+    // once with cache-line aligned destination rows and once without.
+    const size_t shapes[][2] = {{1, 9}, {7, 13}, {33, 65}, {300, 5}, {6, 517}, {1037, 771},
+                                {1024, 1100}, {1029, 1031}};
+    for (const auto& sh : shapes) {
+        size_t M = sh[0], N = sh[1];
+        tensor a{M, N};
+        fill_seq(a, 0.0f);
+        tensor at = a.transpose();
+        expect_shape(at, {N, M});
+        for (size_t i = 0; i < M; i++) {
+            for (size_t j = 0; j < N; j++) {
+                assert(at.data()[j * M + i] == a.data()[i * N + j]);
+            }
+        }
+    }
+
+    cout << "OK\n\n";
+}
+
+// Times a 4096 x 4096 transpose against copying the same tensor (which also
+// allocates its result) and a bare memcpy into an existing buffer. Only
+// printed: the numbers mean something in a release build.
+static void test_transpose_bandwidth() {
+    cout << "=== test_transpose_bandwidth ===\n";
+
+    const size_t n = 4096;
+    tensor a{n, n};
+    fill_seq(a, 0.0f, 1e-3f);
+
+    auto best_ms = [](auto&& fn) {
+        double best = 1e30;
+        for (int rep = 0; rep < 5; rep++) {
+            auto t0 = chrono::steady_clock::now();
+            fn();
+            chrono::duration<double, milli> dt = chrono::steady_clock::now() - t0;
+            best = min(best, dt.count());
+        }
+        return best;
+    };
+
+    tensor at;
+    const double t_transpose = best_ms([&] { at = a.transpose(); });
+    tensor copy;
+    const double t_copy = best_ms([&] { copy = tensor(a); });
+    vector<float> buf(n * n);
+    const double t_memcpy = best_ms([&] { memcpy(buf.data(), a.data(), n * n * sizeof(float)); });
+
+    for (size_t i = 0; i < n; i += 127) {
+        for (size_t j = 0; j < n; j += 131) assert(at.data()[j * n + i] == a.data()[i * n + j]);
+    }
+    cout << "transpose " << n << "x" << n << ": " << t_transpose << " ms, copy " << t_copy
+         << " ms, memcpy " << t_memcpy << " ms (" << t_transpose / t_copy << "x copy, "
+         << t_transpose / t_memcpy << "x memcpy)\n";
+
+    cout << "OK\n\n";
+}
+
+static void test_permute_contiguous() {
+    cout << "=== test_permute_contiguous ===\n";
+
+    const vector<size_t> shape{3, 4, 5, 6};
+    const vector<vector<size_t>> perms{{0, 1, 2, 3}, {3, 2, 1, 0}, {0, 2, 1, 3}, {1, 3, 0, 2}, {2, 0, 3, 1}};
+    tensor src{3, 4, 5, 6};
+    fill_seq(src, 0.0f);
+
+    for (const auto& p : perms) {
+        tensor v = src;
+        v.permute(p);
+        vector<size_t> expected_shape{shape[p[0]], shape[p[1]], shape[p[2]], shape[p[3]]};
+        expect_shape(v, expected_shape);
+
+        tensor c = v.contiguous();
+        assert(c.is_contiguous());
+        expect_shape(c, expected_shape);
+
+        size_t idx[4];
+        size_t flat = 0;
+        for (idx[0] = 0; idx[0] < expected_shape[0]; idx[0]++)
+        for (idx[1] = 0; idx[1] < expected_shape[1]; idx[1]++)
+        for (idx[2] = 0; idx[2] < expected_shape[2]; idx[2]++)
+        for (idx[3] = 0; idx[3] < expected_shape[3]; idx[3]++) {
+            size_t orig[4];
+            for (size_t d = 0; d < 4; d++) orig[p[d]] = idx[d];
+            size_t src_flat = ((orig[0] * 4 + orig[1]) * 5 + orig[2]) * 6 + orig[3];
+            assert(c.data()[flat++] == src.data()[src_flat]);
+        }
+    }
+
+    // Non-contiguous operands are materialised before use.
+    tensor a{3, 2};
+    fill_seq(a, 0.0f);
+    tensor b{2, 3};
+    fill_seq(b, 0.0f);
+    const size_t swap[] = {1, 0};
+    b.permute(swap);
+    assert(!b.is_contiguous());
+    tensor s = a + b;
+    tensor bt = b.contiguous();
+    for (size_t i = 0; i < 6; i++) {
+        assert(nearly_equal(s.data()[i], a.data()[i] + bt.data()[i]));
+    }
+
+    tensor m = b.transpose();
+    expect_shape(m, {2, 3});
+    for (size_t i = 0; i < 6; i++) assert(m.data()[i] == static_cast<float>(i));
+
+    tensor u = a.unsqueeze(1);
+    expect_shape(u, {3, 1, 2});
+    assert(u.is_contiguous());
+    tensor q = u.squeeze(1);
+    expect_shape(q, {3, 2});
+
+    cout << "OK\n\n";
+}
+
+static void test_checkpoint_roundtrip() {
+    cout << "=== test_checkpoint_roundtrip ===\n";
+
+    tensor w{3, 5};
+    tensor b{7};
+    tensor v{4, 2};
+    fill_seq(w, 0.0f, 0.5f);
+    fill_seq(b, -3.0f);
+    fill_seq(v, 100.0f);
+    const size_t swap[] = {1, 0};
+    v.permute(swap); // saved in logical order
+
+    const string path = "tensor_test_checkpoint.bin";
+    hml::checkpoint::save(path, {{"layer.w", &w}, {"layer.b", &b}, {"v", &v}});
+
+    {
+        auto loaded = hml::checkpoint::load(path);
+        assert(loaded.size() == 3);
+
+        const tensor& lw = loaded.at("layer.w");
+        assert(lw.is_external());
+        expect_shape(lw, {3, 5});
+        assert(reinterpret_cast<std::uintptr_t>(lw.data()) % hml::checkpoint::alignment == 0);
+        for (size_t i = 0; i < w.size(); i++) assert(lw.data()[i] == w.data()[i]);
+
+        const tensor& lb = loaded.at("layer.b");
+        expect_shape(lb, {7});
+        assert(reinterpret_cast<std::uintptr_t>(lb.data()) % hml::checkpoint::alignment == 0);
+        for (size_t i = 0; i < b.size(); i++) assert(lb.data()[i] == b.data()[i]);
+
+        const tensor& lv = loaded.at("v");
+        expect_shape(lv, {2, 4});
+        tensor vc = v.contiguous();
+        for (size_t i = 0; i < vc.size(); i++) assert(lv.data()[i] == vc.data()[i]);
+
+        // Copies own their data and ops on mapped tensors work as usual.
+        tensor copy = lw;
+        assert(!copy.is_external());
+        copy += 1.0f;
+        assert(lw.data()[0] == 0.0f && copy.data()[0] == 1.0f);
+        tensor sum = lw + lw;
+        assert(nearly_equal(sum.data()[4], 4.0f));
+
+        // Tensors keep the mapping alive after the map goes away.
+        tensor kept = std::move(loaded.at("layer.b"));
+        loaded.clear();
+        assert(kept.is_external() && kept.data()[6] == 3.0f);
+
+        // Saving over a file that is still mapped replaces it without touching
+        // the old mapping.
+        tensor b2{7};
+        fill_seq(b2, 50.0f);
+        hml::checkpoint::save(path, {{"layer.b", &b2}});
+        assert(kept.data()[6] == 3.0f);
+        assert(hml::checkpoint::load(path).at("layer.b").data()[6] == 56.0f);
+        assert(!ifstream(path + ".tmp." + to_string(getpid())));
+    }
+
+    // Repeated names are rejected on both sides.
+    bool threw = false;
+    try { hml::checkpoint::save(path, {{"ab", &b}, {"ab", &w}}); } catch (const std::invalid_argument&) { threw = true; }
+    assert(threw);
+    hml::checkpoint::save(path, {{"ab", &b}, {"ac", &w}});
+    {
+        std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+        string bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        const size_t at = bytes.find("ac");
+        assert(at != string::npos);
+        f.seekp(static_cast<std::streamoff>(at + 1));
+        f.put('b');
+    }
+    threw = false;
+    try { hml::checkpoint::load(path); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+
+    std::remove(path.c_str());
+    cout << "OK\n\n";
+}
+
+static void test_pool_task_exceptions() {
+    cout << "=== test_pool_task_exceptions ===\n";
+    namespace parallel = hml::parallel;
+
+    // A task throwing on any thread comes back out of run() on the caller, after
+    // every task that had started has finished.
+    parallel::thread_pool pool(4);
+    atomic<int> running{0}, finished{0};
+    bool threw = false;
+    try {
+        pool.run(64, [&](size_t t) {
+            running++;
+            this_thread::sleep_for(chrono::microseconds(200));
+            running--;
+            if (t % 9 == 4) throw runtime_error("task " + to_string(t));
+            finished++;
+        });
+    } catch (const runtime_error&) {
+        threw = true;
+    }
+    assert(threw && running == 0);
+    const int done = finished;
+    this_thread::sleep_for(chrono::milliseconds(5));
+    assert(finished == done && done < 64);
+
+    // The pool, and the calling thread's place in it, are fine afterwards.
+    mutex ids_mutex;
+    set<thread::id> ids;
+    pool.run(16, [&](size_t) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+        lock_guard<mutex> lock(ids_mutex);
+        ids.insert(this_thread::get_id());
+    });
+    assert(ids.size() > 1);
+
+    // Same through parallel_for on the shared pool.
+    assert(parallel::num_threads() > 1);
+    threw = false;
+    try {
+        parallel::parallel_for(0, 1000, 1, [&](size_t lo, size_t) {
+            if (lo > 0) throw runtime_error("chunk");
+        });
+    } catch (const runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    cout << "OK\n\n";
+}
+
 static void test_vector_transpose_throws() {
     cout << "=== test_vector_transpose_throws ===\n";
     tensor v{5};
@@ -258,11 +572,19 @@ static void test_vector_transpose_throws() {
 }
 
 int main() {
+    // Make sure the shared pool has workers even on a one-core machine.
+    setenv("HML_NUM_THREADS", "4", 0);
     try {
         test_elementwise_ops();
         test_transpose_2d();
         test_transpose_batched_3d();
         test_batched_matmul();
+        test_parallel_large_ops();
+        test_transpose_odd_sizes();
+        test_transpose_bandwidth();
+        test_permute_contiguous();
+        test_checkpoint_roundtrip();
+        test_pool_task_exceptions();
         test_vector_transpose_throws();
 
         cout << "ALL TESTS PASSED ✅\n";
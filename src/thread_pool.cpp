@@ -0,0 +1,138 @@
+#include "../include/thread_pool.hpp"
+#include <cstdlib>
+#include <exception>
+#include <string>
+
+namespace hml::parallel {
+    static thread_local bool in_worker = false;
+
+    // Marks the calling thread as a pool thread for the duration of run(), so
+    // nested parallel loops in its tasks stay inline.
+    namespace {
+        struct worker_scope {
+            worker_scope() noexcept { in_worker = true; }
+            ~worker_scope() { in_worker = false; }
+            worker_scope(const worker_scope&) = delete;
+            worker_scope& operator=(const worker_scope&) = delete;
+        };
+    }
+
+    thread_pool::thread_pool(std::size_t num_threads) {
+        // The calling thread always takes part in run(), so spawn one fewer worker.
+        for (std::size_t i = 1; i < num_threads; i++) {
+            workers_.emplace_back([this] { worker_loop(); });
+        }
+    }
+
+    thread_pool::~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        workers_.clear();
+    }
+
+    std::size_t thread_pool::size() const noexcept { return workers_.size() + 1; }
+
+    // A task that throws keeps the first exception for run() to rethrow and
+    // stops every thread from claiming further tasks.
+    void thread_pool::drain() noexcept {
+        for (std::size_t t = next_task_.fetch_add(1); t < num_tasks_; t = next_task_.fetch_add(1)) {
+            try {
+                (*job_)(t);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_) error_ = std::current_exception();
+                next_task_.store(num_tasks_);
+            }
+        }
+    }
+
+    void thread_pool::worker_loop() {
+        in_worker = true;
+        std::size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+                active_++;
+            }
+            drain();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--active_ == 0) done_cv_.notify_all();
+        }
+    }
+
+    void thread_pool::run(std::size_t num_tasks, const std::function<void(std::size_t)>& fn) {
+        if (num_tasks == 0) return;
+
+        std::unique_lock<std::mutex> submit(submit_mutex_, std::try_to_lock);
+        if (in_worker || workers_.empty() || num_tasks == 1 || !submit.owns_lock()) {
+            for (std::size_t t = 0; t < num_tasks; t++) fn(t);
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_cv_.wait(lock, [&] { return active_ == 0; });
+            job_ = &fn;
+            num_tasks_ = num_tasks;
+            next_task_.store(0);
+            generation_++;
+        }
+        work_cv_.notify_all();
+
+        {
+            worker_scope scope;
+            drain();
+        }
+
+        // Every task has been claimed once drain() returns; wait for the workers
+        // still running theirs so no one touches fn after we return.
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_cv_.wait(lock, [&] { return active_ == 0; });
+            job_ = nullptr;
+            num_tasks_ = 0;
+            std::swap(error, error_);
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+    static std::size_t configured_threads() {
+        if (const char* env = std::getenv("HML_NUM_THREADS")) {
+            try {
+                long n = std::stol(env);
+                if (n > 0) return static_cast<std::size_t>(n);
+            } catch (const std::exception&) {}
+        }
+        std::size_t hw = std::thread::hardware_concurrency();
+        return hw == 0 ? 1 : hw;
+    }
+
+    thread_pool& default_pool() {
+        static thread_pool pool(configured_threads());
+        return pool;
+    }
+
+    std::size_t num_threads() {
+        static const std::size_t n = default_pool().size();
+        return n;
+    }
+
+    namespace detail {
+        void parallel_for_impl(std::size_t begin, std::size_t end, std::size_t chunk,
+                               const std::function<void(std::size_t, std::size_t)>& fn) {
+            const std::size_t tasks = (end - begin + chunk - 1) / chunk;
+            default_pool().run(tasks, [&](std::size_t t) {
+                const std::size_t lo = begin + t * chunk;
+                const std::size_t hi = lo + chunk < end ? lo + chunk : end;
+                fn(lo, hi);
+            });
+        }
+    }
+}
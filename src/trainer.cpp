@@ -0,0 +1,94 @@
+#include "../include/trainer.hpp"
+#include "../include/play_store.hpp"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+
+namespace hml::train {
+    std::vector<std::vector<play::play_event>> load_shard(const options& opts, std::size_t rank, std::size_t world) {
+        std::vector<std::vector<play::play_event>> games;
+        if (opts.data_dir.empty()) {
+            for (std::size_t i = rank; i < opts.synthetic_games; i += world) {
+                games.push_back(play::synthetic_game(static_cast<std::uint32_t>(2023020001u + i), 200 + (i * 37) % 200, opts.seed + i));
+            }
+        } else {
+            // Column files hold each game's plays contiguously, so a game ends where game_id changes.
+            std::size_t index = 0;
+            for (const auto& s : store::open_seasons(opts.data_dir, opts.first_season, opts.last_season)) {
+                const auto* ids = s.get<std::uint32_t>(store::column::game);
+                for (std::size_t lo = 0; lo < s.rows();) {
+                    std::size_t hi = lo + 1;
+                    while (hi < s.rows() && ids[hi] == ids[lo]) hi++;
+                    if (index++ % world == rank) {
+                        auto& g = games.emplace_back();
+                        g.reserve(hi - lo);
+                        for (std::size_t r = lo; r < hi; r++) g.push_back(s.row(r));
+                    }
+                    lo = hi;
+                }
+            }
+        }
+        if (games.empty()) throw std::runtime_error("train: rank " + std::to_string(rank) + " has no games to train on");
+        return games;
+    }
+
+    static double seconds_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    report run(model::transformer& model, const std::vector<std::vector<play::play_event>>& games,
+               const options& opts, dist::ring& ring) {
+        if (opts.window == 0 || opts.window > model.get_config().max_seq) throw std::invalid_argument("train: window must be in 1..max_seq");
+        if (opts.batch == 0) throw std::invalid_argument("train: batch must be positive");
+        if (games.empty()) throw std::invalid_argument("train: no games");
+
+        model.flatten();
+        auto grads = model.zeros_like();
+        model::train_workspace ws(model.get_config(), opts.batch, opts.window);
+        dist::bucket_reducer reducer(ring, std::max<std::size_t>(1, opts.bucket_kb * 1024 / sizeof(float)));
+        const auto on_ready = [&](std::size_t begin, std::size_t end) { reducer.ready(begin, end); };
+
+        // Each rank draws different windows from its own shard.
+        std::mt19937_64 rng(opts.seed * 0x9e3779b97f4a7c15ull + ring.rank());
+        std::vector<model::sample> batch(opts.batch);
+        const std::span<float> params = model.parameters();
+        const std::span<float> g = grads.parameters();
+        optim::optimizer opt(params.size(), opts.optim);
+
+        report rep;
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t step = 0; step < opts.steps; step++) {
+            for (auto& s : batch) {
+                const auto& game = games[rng() % games.size()];
+                const std::size_t len = std::min(opts.window, game.size());
+                const std::size_t first = rng() % (game.size() - len + 1);
+                s.plays = std::span<const play::play_event>(game).subspan(first, len);
+                s.home_win = game.back().home_score > game.back().away_score ? 1.0f : 0.0f;
+            }
+
+            std::fill(g.begin(), g.end(), 0.0f);
+            reducer.begin(g);
+            const auto compute_start = std::chrono::steady_clock::now();
+            float loss = model.train_batch(batch, ws, grads, on_ready);
+            rep.compute_seconds += seconds_since(compute_start);
+            reducer.finish();
+            rep.comm_seconds += reducer.comm_seconds();
+            rep.exposed_seconds += reducer.exposed_seconds();
+
+            const auto optimizer_start = std::chrono::steady_clock::now();
+            opt.step(params, g);
+            rep.optimizer_seconds += seconds_since(optimizer_start);
+
+            ring.all_reduce(std::span<float>(&loss, 1));
+            loss /= static_cast<float>(ring.world());
+            if (step == 0) rep.first_loss = loss;
+            rep.last_loss = loss;
+        }
+        rep.seconds = seconds_since(start);
+        rep.steps = opts.steps;
+        rep.samples = opts.steps * opts.batch * ring.world();
+        rep.bytes_sent = ring.bytes_sent();
+        return rep;
+    }
+}